@@ -0,0 +1,118 @@
+// esTransformBench.c
+//
+//    Microbenchmark for the matrix kernels in esTransform.c.  Compares the
+//    original scalar esMatrixMultiply (kept here as a reference copy) with
+//    the current esMatrixMultiply and esMatrixMultiplyBatch, and prints
+//    matrices per second for each.
+//
+//    Build and run natively with "make bench", or as wasm simd128 under
+//    node with "make bench-wasm".
+//
+
+#include "esUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_MATRICES   4096
+#define NUM_ITERATIONS 500
+
+//
+// The scalar triple loop esMatrixMultiply used before the SIMD kernels
+//
+static void referenceMultiply(ESMatrix *result, ESMatrix *srcA, ESMatrix *srcB)
+{
+    ESMatrix    tmp;
+    int         i, j;
+
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            tmp.m[i][j] = (srcA->m[i][0] * srcB->m[0][j]) +
+                          (srcA->m[i][1] * srcB->m[1][j]) +
+                          (srcA->m[i][2] * srcB->m[2][j]) +
+                          (srcA->m[i][3] * srcB->m[3][j]);
+        }
+    }
+    memcpy(result, &tmp, sizeof(ESMatrix));
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double seconds)
+{
+    double count = (double)NUM_MATRICES * NUM_ITERATIONS;
+    printf("%-24s %8.3f ms  %10.2f Mmatrices/s\n", name, seconds * 1000.0, count / seconds * 1e-6);
+}
+
+int main(int argc, char *argv[])
+{
+    ESMatrix *a   = (ESMatrix*)malloc(sizeof(ESMatrix) * NUM_MATRICES);
+    ESMatrix *b   = (ESMatrix*)malloc(sizeof(ESMatrix) * NUM_MATRICES);
+    ESMatrix *out = (ESMatrix*)malloc(sizeof(ESMatrix) * NUM_MATRICES);
+    ESMatrix  check;
+    double    t0, maxError = 0.0;
+    float     sink = 0.0f;
+    int       i, j, it;
+
+    srand(1234);
+    for (i = 0; i < NUM_MATRICES; i++)
+    {
+        for (j = 0; j < 16; j++)
+        {
+            (&a[i].m[0][0])[j] = (float)rand() / (float)RAND_MAX - 0.5f;
+            (&b[i].m[0][0])[j] = (float)rand() / (float)RAND_MAX - 0.5f;
+        }
+    }
+
+    t0 = now();
+    for (it = 0; it < NUM_ITERATIONS; it++)
+    {
+        for (i = 0; i < NUM_MATRICES; i++)
+            referenceMultiply(&out[i], &a[i], &b[i]);
+        sink += out[it % NUM_MATRICES].m[0][0];
+    }
+    report("reference (scalar)", now() - t0);
+
+    t0 = now();
+    for (it = 0; it < NUM_ITERATIONS; it++)
+    {
+        for (i = 0; i < NUM_MATRICES; i++)
+            esMatrixMultiply(&out[i], &a[i], &b[i]);
+        sink += out[it % NUM_MATRICES].m[0][0];
+    }
+    report("esMatrixMultiply", now() - t0);
+
+    t0 = now();
+    for (it = 0; it < NUM_ITERATIONS; it++)
+    {
+        esMatrixMultiplyBatch(out, a, b, NUM_MATRICES);
+        sink += out[it % NUM_MATRICES].m[0][0];
+    }
+    report("esMatrixMultiplyBatch", now() - t0);
+
+    // Make sure the fast paths agree with the reference
+    for (i = 0; i < NUM_MATRICES; i++)
+    {
+        referenceMultiply(&check, &a[i], &b[i]);
+        for (j = 0; j < 16; j++)
+        {
+            double d = (&check.m[0][0])[j] - (&out[i].m[0][0])[j];
+            if (d < 0.0) d = -d;
+            if (d > maxError) maxError = d;
+        }
+    }
+    printf("max abs error vs reference: %g (%g)\n", maxError, (double)sink);
+
+    free(a);
+    free(b);
+    free(out);
+    return maxError < 1e-5 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+//
+// esMath.hpp
+//
+//    Header-only C++ math layer over the esUtil.h types.  Vec3, Quat and
+//    Mat4 derive from ESVec3, ESQuaternion and ESMatrix without adding any
+//    members, so they can be passed straight to the C API (and C results
+//    used directly) while letting the compiler inline and constant fold
+//    everything defined here.
+//
+//    Conventions follow esTransform.c: Mat4 is stored like ESMatrix and
+//    a * b is esMatrixMultiply(a, b).  A chain of esTranslate, esRotate,
+//    esScale on identity equals scaling(s) * rotation(q) * translation(t).
+//
+#ifndef ESMATH_HPP
+#define ESMATH_HPP
+
+#include "esUtil.h"
+#include <math.h>
+
+namespace es
+{
+
+struct Vec3 : ESVec3
+{
+    constexpr Vec3() : ESVec3{ 0.0f, 0.0f, 0.0f } {}
+    constexpr Vec3(GLfloat x, GLfloat y, GLfloat z) : ESVec3{ x, y, z } {}
+    constexpr Vec3(const ESVec3 &v) : ESVec3(v) {}
+
+    constexpr Vec3 operator+(const Vec3 &b) const { return Vec3(x + b.x, y + b.y, z + b.z); }
+    constexpr Vec3 operator-(const Vec3 &b) const { return Vec3(x - b.x, y - b.y, z - b.z); }
+    constexpr Vec3 operator-() const { return Vec3(-x, -y, -z); }
+    constexpr Vec3 operator*(GLfloat s) const { return Vec3(x * s, y * s, z * s); }
+};
+
+inline constexpr GLfloat dot(const Vec3 &a, const Vec3 &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline constexpr Vec3 cross(const Vec3 &a, const Vec3 &b)
+{
+    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline GLfloat length(const Vec3 &v)
+{
+    return sqrtf(dot(v, v));
+}
+
+inline Vec3 normalize(const Vec3 &v)
+{
+    GLfloat len = length(v);
+    return len > 0.0f ? v * (1.0f / len) : v;
+}
+
+struct Quat : ESQuaternion
+{
+    constexpr Quat() : ESQuaternion{ 0.0f, 0.0f, 0.0f, 1.0f } {}
+    constexpr Quat(GLfloat x, GLfloat y, GLfloat z, GLfloat w) : ESQuaternion{ x, y, z, w } {}
+    constexpr Quat(const ESQuaternion &q) : ESQuaternion(q) {}
+
+    /// Hamilton product, same as esQuaternionMultiply
+    constexpr Quat operator*(const Quat &b) const
+    {
+        return Quat(w * b.x + x * b.w + y * b.z - z * b.y,
+                    w * b.y - x * b.z + y * b.w + z * b.x,
+                    w * b.z + x * b.y - y * b.x + z * b.w,
+                    w * b.w - x * b.x - y * b.y - z * b.z);
+    }
+
+    /// Rotation matching esRotate(angle, axis), angle in degrees
+    static Quat axisAngle(GLfloat angle, const Vec3 &axis)
+    {
+        GLfloat mag = length(axis);
+        GLfloat halfAngle = angle * 3.1415926535897932384626433832795f / 360.0f;
+        GLfloat s;
+
+        if ( mag <= 0.0f )
+            return Quat();
+
+        s = sinf(halfAngle) / mag;
+        return Quat(axis.x * s, axis.y * s, axis.z * s, cosf(halfAngle));
+    }
+};
+
+struct Mat4 : ESMatrix
+{
+    /// Zero matrix; use identity() for the identity
+    constexpr Mat4() : ESMatrix{} {}
+    constexpr Mat4(const ESMatrix &m) : ESMatrix(m) {}
+
+    constexpr Mat4(GLfloat m00, GLfloat m01, GLfloat m02, GLfloat m03,
+                   GLfloat m10, GLfloat m11, GLfloat m12, GLfloat m13,
+                   GLfloat m20, GLfloat m21, GLfloat m22, GLfloat m23,
+                   GLfloat m30, GLfloat m31, GLfloat m32, GLfloat m33)
+        : ESMatrix{ { { m00, m01, m02, m03 },
+                      { m10, m11, m12, m13 },
+                      { m20, m21, m22, m23 },
+                      { m30, m31, m32, m33 } } } {}
+
+    static constexpr Mat4 identity()
+    {
+        return Mat4(1.0f, 0.0f, 0.0f, 0.0f,
+                    0.0f, 1.0f, 0.0f, 0.0f,
+                    0.0f, 0.0f, 1.0f, 0.0f,
+                    0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    /// Same product as esMatrixMultiply(result, this, b)
+    constexpr Mat4 operator*(const Mat4 &b) const
+    {
+        Mat4 r;
+        for ( int i = 0; i < 4; i++ )
+            for ( int j = 0; j < 4; j++ )
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] +
+                            m[i][2] * b.m[2][j] + m[i][3] * b.m[3][j];
+        return r;
+    }
+
+    /// Transform a point, with the same row-vector convention the shaders see
+    constexpr Vec3 transformPoint(const Vec3 &p) const
+    {
+        return Vec3(p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0],
+                    p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1],
+                    p.x * m[0][2] + p.y * m[1][2] + p.z * m[2][2] + m[3][2]);
+    }
+
+    static constexpr Mat4 translation(const Vec3 &t)
+    {
+        return Mat4(1.0f, 0.0f, 0.0f, 0.0f,
+                    0.0f, 1.0f, 0.0f, 0.0f,
+                    0.0f, 0.0f, 1.0f, 0.0f,
+                    t.x,  t.y,  t.z,  1.0f);
+    }
+
+    static constexpr Mat4 scaling(const Vec3 &s)
+    {
+        return Mat4(s.x,  0.0f, 0.0f, 0.0f,
+                    0.0f, s.y,  0.0f, 0.0f,
+                    0.0f, 0.0f, s.z,  0.0f,
+                    0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    /// Same matrix esComposeTRS builds
+    static constexpr Mat4 trs(const Vec3 &pos, const Quat &q, const Vec3 &s)
+    {
+        return Mat4((1.0f - 2.0f * (q.y * q.y + q.z * q.z)) * s.x,
+                    2.0f * (q.x * q.y - q.z * q.w) * s.x,
+                    2.0f * (q.z * q.x + q.y * q.w) * s.x,
+                    0.0f,
+                    2.0f * (q.x * q.y + q.z * q.w) * s.y,
+                    (1.0f - 2.0f * (q.x * q.x + q.z * q.z)) * s.y,
+                    2.0f * (q.y * q.z - q.x * q.w) * s.y,
+                    0.0f,
+                    2.0f * (q.z * q.x - q.y * q.w) * s.z,
+                    2.0f * (q.y * q.z + q.x * q.w) * s.z,
+                    (1.0f - 2.0f * (q.x * q.x + q.y * q.y)) * s.z,
+                    0.0f,
+                    pos.x, pos.y, pos.z, 1.0f);
+    }
+
+    static constexpr Mat4 rotation(const Quat &q)
+    {
+        return trs(Vec3(), q, Vec3(1.0f, 1.0f, 1.0f));
+    }
+
+    /// The matrix esFrustum multiplies in; identity if the arguments are invalid, as esFrustum leaves result unchanged
+    static constexpr Mat4 frustum(float left, float right, float bottom, float top, float nearZ, float farZ)
+    {
+        return ( nearZ <= 0.0f || farZ <= 0.0f || right - left <= 0.0f ||
+                 top - bottom <= 0.0f || farZ - nearZ <= 0.0f ) ? identity() :
+            Mat4(2.0f * nearZ / (right - left), 0.0f, 0.0f, 0.0f,
+                 0.0f, 2.0f * nearZ / (top - bottom), 0.0f, 0.0f,
+                 (right + left) / (right - left), (top + bottom) / (top - bottom),
+                 -(nearZ + farZ) / (farZ - nearZ), -1.0f,
+                 0.0f, 0.0f, -2.0f * nearZ * farZ / (farZ - nearZ), 0.0f);
+    }
+
+    /// The matrix esOrtho multiplies in; identity if the arguments are invalid
+    static constexpr Mat4 ortho(float left, float right, float bottom, float top, float nearZ, float farZ)
+    {
+        return ( right - left == 0.0f || top - bottom == 0.0f || farZ - nearZ == 0.0f ) ? identity() :
+            Mat4(2.0f / (right - left), 0.0f, 0.0f, 0.0f,
+                 0.0f, 2.0f / (top - bottom), 0.0f, 0.0f,
+                 0.0f, 0.0f, -2.0f / (farZ - nearZ), 0.0f,
+                 -(right + left) / (right - left), -(top + bottom) / (top - bottom),
+                 -(nearZ + farZ) / (farZ - nearZ), 1.0f);
+    }
+
+    /// The matrix esPerspective multiplies in, fovy in degrees
+    static inline Mat4 perspective(float fovy, float aspect, float nearZ, float farZ)
+    {
+        float frustumH = tanf(fovy / 360.0f * 3.1415926535897932384626433832795f) * nearZ;
+        float frustumW = frustumH * aspect;
+        return frustum(-frustumW, frustumW, -frustumH, frustumH, nearZ, farZ);
+    }
+};
+
+static_assert(sizeof(Vec3) == sizeof(ESVec3), "es::Vec3 must stay layout-compatible with ESVec3");
+static_assert(sizeof(Quat) == sizeof(ESQuaternion), "es::Quat must stay layout-compatible with ESQuaternion");
+static_assert(sizeof(Mat4) == sizeof(ESMatrix), "es::Mat4 must stay layout-compatible with ESMatrix");
+
+} // namespace es
+
+#endif // ESMATH_HPP
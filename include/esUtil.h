@@ -23,8 +23,89 @@ extern "C" {
 #define ES_WINDOW_STENCIL       4
 /// esCreateWindow flat - multi-sample buffer
 #define ES_WINDOW_MULTISAMPLE   8
+/// esCreateWindow flag - render on a dedicated thread through OffscreenCanvas (needs USE_PTHREADS)
+#define ES_WINDOW_OFFSCREEN     16
 
 
+/// Bytes per vertex written by the interleaved generators: position (3), normal (3), texcoord (2) floats
+#define ES_INTERLEAVED_VERTEX_SIZE  (8 * sizeof(GLfloat))
+
+/// esGenSphereMesh flag - allow GL_UNSIGNED_INT indices (OES_element_index_uint)
+#define ES_MESH_UINT_INDICES        1
+/// esGenSphereMesh flag - reorder for the vertex cache and vertex fetch, see esOptimizeMesh
+#define ES_MESH_OPTIMIZE            2
+
+/// esPackVertices format flag - half float positions; float positions are used without OES_vertex_half_float
+#define ES_VERTEX_POSITION_HALF     1
+/// esPackVertices format flag - snorm16 positions, scaled by ESVertexLayout::positionScale
+#define ES_VERTEX_POSITION_SNORM16  2
+/// esPackVertices format flag - octahedral normals in two snorm8 components, decode with ES_GLSL_OCT_DECODE
+#define ES_VERTEX_NORMAL_OCT8       4
+/// esPackVertices format flag - octahedral normals in two snorm16 components, decode with ES_GLSL_OCT_DECODE
+#define ES_VERTEX_NORMAL_OCT16      8
+/// esPackVertices format flag - unorm16 texcoords over their range, decode with ESVertexLayout::texCoordScale and texCoordBias
+#define ES_VERTEX_TEXCOORD_UNORM16  16
+/// 16 bytes per vertex instead of 32: snorm16 position, oct8 normal, unorm16 texcoord
+#define ES_VERTEX_PACKED            ( ES_VERTEX_POSITION_SNORM16 | ES_VERTEX_NORMAL_OCT8 | ES_VERTEX_TEXCOORD_UNORM16 )
+
+/// GLSL function vec3 esOctDecode(vec2) that turns an octahedral-encoded normal attribute back into a unit vector
+#define ES_GLSL_OCT_DECODE \
+   "vec3 esOctDecode(vec2 e)\n" \
+   "{\n" \
+   "   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n" \
+   "   if (n.z < 0.0)\n" \
+   "      n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n" \
+   "   return normalize(n);\n" \
+   "}\n"
+
+/// Maximum number of levels in an ESLodChain
+#define ES_MAX_LOD_LEVELS           8
+
+/// Post-transform cache size assumed by ES_MESH_OPTIMIZE
+#define ES_VERTEX_CACHE_SIZE        16
+
+/// Shapes understood by esGeometryAcquire
+#define ES_SHAPE_SPHERE             1
+#define ES_SHAPE_CUBE               2
+
+/// Number of distinct geometries esGeometryAcquire can hold at once
+#define ES_GEOMETRY_CACHE_SIZE      64
+
+/// Number of GL buffers in the esStreamAlloc ring
+#define ES_STREAM_BUFFERS           3
+
+/// Byte alignment of esStreamAlloc offsets
+#define ES_STREAM_ALIGNMENT         16
+
+/// Per-instance data formats for esInstancedMeshInit
+/// ES_INSTANCE_MATRIX - one ESMatrix (16 floats) per instance
+/// ES_INSTANCE_TRS    - position xyz and uniform scale, then rotation quaternion xyzw (8 floats)
+#define ES_INSTANCE_MATRIX          1
+#define ES_INSTANCE_TRS             2
+
+/// Vertex attribute arrays tracked by the esState* functions
+#define ES_STATE_MAX_ATTRIBS        16
+
+/// Texture units whose bindings are tracked by esStateBindTexture
+#define ES_STATE_MAX_TEXTURE_UNITS  8
+
+/// Number of distinct programs esProgramRequest can hold
+#define ES_PROGRAM_CACHE_SIZE       128
+
+/// ESProgram status
+#define ES_PROGRAM_FAILED           -1
+#define ES_PROGRAM_PENDING          0
+#define ES_PROGRAM_READY            1
+
+/// Number of (source, feature mask) variants esShaderVariantGet can hold
+#define ES_VARIANT_CACHE_SIZE       256
+
+/// Attribute and uniform names resolved per shader variant
+#define ES_VARIANT_MAX_LOCATIONS    16
+
+/// Timer queries in flight for ESDynamicResolution; results are read this many frames late at most
+#define ES_RESOLUTION_QUERIES       4
+
 #ifndef FALSE
 #define FALSE 0
 #endif
@@ -37,6 +118,425 @@ typedef struct
     GLfloat   m[4][4];
 } ESMatrix;
 
+typedef struct
+{
+    GLfloat   m[3][3];
+} ESMatrix3;
+
+typedef struct
+{
+    GLfloat   x, y, z;
+} ESVec3;
+
+typedef struct
+{
+    GLfloat   x, y, z, w;
+} ESQuaternion;
+
+///
+/// Structure-of-arrays transforms for esComposeTRSBatch.  Each pointer
+/// refers to an array with one float per object.
+///
+typedef struct
+{
+    const GLfloat *px, *py, *pz;
+    const GLfloat *qx, *qy, *qz, *qw;
+    const GLfloat *sx, *sy, *sz;
+} ESTransformArrays;
+
+///
+/// Range of an ESMesh drawn with one glDrawElements call.  Indices are
+/// relative to firstVertex.
+///
+typedef struct
+{
+    int       firstVertex;
+    int       numVertices;
+    int       firstIndex;
+    int       numIndices;
+} ESSubMesh;
+
+///
+/// Generated mesh with interleaved vertices (ES_INTERLEAVED_VERTEX_SIZE
+/// bytes each) and GL_UNSIGNED_SHORT or GL_UNSIGNED_INT indices
+///
+typedef struct
+{
+    GLfloat   *vertices;
+    int        numVertices;
+    void      *indices;
+    int        numIndices;
+    GLenum     indexType;
+    ESSubMesh *subMeshes;
+    int        numSubMeshes;
+} ESMesh;
+
+///
+/// Discrete levels of detail of one shape.  Each level is a sub-mesh of
+/// mesh, whose vertices and indices share a single allocation.
+///
+typedef struct
+{
+    ESMesh     mesh;
+    int        slices[ES_MAX_LOD_LEVELS];
+    GLfloat    radius;
+} ESLodChain;
+
+///
+/// One vertex attribute in an ESVertexLayout, in glVertexAttribPointer terms
+///
+typedef struct
+{
+    GLint      size;
+    GLenum     type;
+    GLboolean  normalized;
+    GLsizei    offset;
+} ESVertexAttrib;
+
+///
+/// Interleaved vertex layout produced by esPackVertices
+///
+typedef struct
+{
+    GLuint          format;
+    GLsizei         stride;
+    ESVertexAttrib  position;
+    ESVertexAttrib  normal;
+    ESVertexAttrib  texCoord;
+    /// Multiply decoded positions by this, e.g. with esScale on the model matrix (1 unless ES_VERTEX_POSITION_SNORM16)
+    GLfloat         positionScale;
+    /// Texcoords are the attribute * texCoordScale + texCoordBias (1 and 0 unless ES_VERTEX_TEXCOORD_UNORM16)
+    GLfloat         texCoordScale[2];
+    GLfloat         texCoordBias[2];
+} ESVertexLayout;
+
+///
+/// Shared, uploaded geometry from esGeometryAcquire.  Sub-meshes index
+/// vertexBuffer and indexBuffer like an ESMesh; treat as read only.
+///
+typedef struct
+{
+    int             shape;
+    int             slices;
+    GLfloat         scale;
+    GLuint          format;
+    int             refCount;
+    GLuint          vertexBuffer;
+    GLuint          indexBuffer;
+    ESVertexLayout  layout;
+    int             numVertices;
+    int             numIndices;
+    GLenum          indexType;
+    ESSubMesh      *subMeshes;
+    int             numSubMeshes;
+} ESGeometry;
+
+///
+/// Memory returned by esStreamAlloc.  Write to ptr, call esStreamFlush, then
+/// source the data from buffer at byte offset.
+///
+typedef struct
+{
+    void           *ptr;
+    GLuint          buffer;
+    GLsizeiptr      offset;
+} ESStreamAlloc;
+
+///
+/// A mesh prepared for esDrawInstanced, with either ANGLE_instanced_arrays
+/// or the uniform array fallback
+///
+typedef struct
+{
+    GLuint     format;
+    int        vec4sPerInstance;
+    GLboolean  instancedArrays;
+    /// Instances per draw call on the uniform array path
+    int        batchSize;
+    GLuint     vertexBuffer;
+    GLuint     indexBuffer;
+    int        numVertices;
+    int        numIndices;
+    GLint      instanceLoc[4];
+    GLint      instanceIdLoc;
+    GLint      instanceDataLoc;
+    /// GLSL to prepend to the vertex shader; declares esInstancePosition(vec3) and esInstanceNormal(vec3)
+    char       shaderHeader[1024];
+} ESInstancedMesh;
+
+///
+/// GL calls made and avoided by the esState* functions
+///
+typedef struct
+{
+    unsigned int   issued;
+    unsigned int   skipped;
+} ESStateStats;
+
+/// Render queue sort key, see esMakeSortKey
+typedef unsigned long long ESSortKey;
+
+///
+/// One deferred draw in an ESRenderQueue
+///
+typedef struct
+{
+    ESSortKey  key;
+    GLuint     program;
+    void       (ESCALLBACK *drawFunc) ( void * );
+    void      *data;
+} ESRenderItem;
+
+///
+/// Draw items collected for one frame, executed in sort key order
+///
+typedef struct
+{
+    ESRenderItem *items;
+    ESRenderItem *scratch;
+    int           count;
+    int           capacity;
+} ESRenderQueue;
+
+///
+/// Vertex format of ESSpriteBatch: 2D position, texcoord and normalized RGBA color
+///
+typedef struct
+{
+    GLfloat    x, y;
+    GLfloat    u, v;
+    GLubyte    color[4];
+} ESSpriteVertex;
+
+///
+/// Textured quads collected into as few draw calls as texture and program changes allow
+///
+typedef struct
+{
+    ESSpriteVertex *vertices;
+    int             numQuads;
+    int             maxQuads;
+    GLuint          indexBuffer;
+    GLuint          texture;
+    GLuint          program;
+    GLint           positionLoc;
+    GLint           texCoordLoc;
+    GLint           colorLoc;
+    /// Draw calls issued since esSpriteBatchBegin
+    int             batches;
+} ESSpriteBatch;
+
+///
+/// Recorded commands for esCommandBufferExecute, filled by the esCmd* functions
+///
+typedef struct
+{
+    unsigned char *data;
+    int            size;
+    int            capacity;
+    /// Set when a command did not fit; the commands recorded before it are kept
+    GLboolean      overflow;
+} ESCommandBuffer;
+
+///
+/// An active uniform or attribute of a linked program.  Array uniforms are
+/// named without the trailing "[0]"; size is the number of elements.
+///
+typedef struct
+{
+    const char  *name;
+    GLint        location;
+    GLenum       type;
+    GLint        size;
+    /// Offset of the uniform's last uploaded value in ESReflection.values, in 4-byte words
+    int          valueOffset;
+} ESShaderVariable;
+
+///
+/// Active uniforms and attributes of a program, enumerated once after
+/// linking and looked up by name through a small hash table.
+///
+typedef struct
+{
+    GLuint            program;
+    /// numUniforms uniforms followed by numAttribs attributes
+    ESShaderVariable *variables;
+    int               numUniforms;
+    int               numAttribs;
+    /// Slots hold variable index + 1, 0 when empty; tableMask + 1 slots
+    GLushort         *table;
+    GLuint            tableMask;
+    /// Last value uploaded to every uniform, starting at zero like GL
+    GLuint           *values;
+    /// Per uniform, nonzero while its entry in values matches GL
+    unsigned char    *known;
+    /// esReflectionInvalidate ( NULL ) count the known flags were last checked against
+    GLuint            epoch;
+    char             *names;
+} ESReflection;
+
+///
+/// A program built by esProgramRequest.  program may only be used once
+/// status is ES_PROGRAM_READY.
+///
+typedef struct
+{
+    unsigned long long  hash;
+    GLuint              program;
+    GLuint              vertexShader;
+    GLuint              fragmentShader;
+    int                 status;
+    /// Built when the program becomes ready, NULL before
+    ESReflection       *reflection;
+} ESProgram;
+
+///
+/// A shader with optional features.  Bit i of a feature mask compiles the
+/// sources with "#define features[i] 1".  Names are NULL terminated lists;
+/// the strings must stay valid while variants can still be requested.
+///
+typedef struct
+{
+    const char          *vertShaderSrc;
+    const char          *fragShaderSrc;
+    const char *const   *features;
+    const char *const   *attribs;
+    const char *const   *uniforms;
+    unsigned long long   hash;
+} ESShaderSource;
+
+///
+/// One compiled feature combination of an ESShaderSource.  attribLocs,
+/// uniformLocs and uniformVars follow the order of the source's attribs
+/// and uniforms.
+///
+typedef struct
+{
+    unsigned long long   sourceHash;
+    GLuint               mask;
+    const ESProgram     *program;
+    GLboolean            resolved;
+    GLint                attribLocs[ES_VARIANT_MAX_LOCATIONS];
+    GLint                uniformLocs[ES_VARIANT_MAX_LOCATIONS];
+    /// Reflected uniforms for the esSetUniform* functions, NULL if inactive or without reflection
+    ESShaderVariable    *uniformVars[ES_VARIANT_MAX_LOCATIONS];
+} ESShaderVariant;
+
+///
+/// Renders the scene into a scaled offscreen target and upscales it to the
+/// window, adjusting the scale to hold a target frame time
+///
+typedef struct
+{
+    GLuint       framebuffer;
+    GLuint       colorTexture;
+    GLuint       depthRenderbuffer;
+    /// Size of the offscreen target, which follows the window size
+    GLint        width;
+    GLint        height;
+    /// Part of the target rendered this frame; set the viewport to this, as esDynamicResolutionBegin does
+    GLint        renderWidth;
+    GLint        renderHeight;
+
+    GLfloat      scale;
+    GLfloat      minScale;
+    GLfloat      maxScale;
+    /// Frame time to hold, in seconds
+    GLfloat      targetTime;
+    /// Smoothed GPU time per frame, or frame interval without timer queries, in seconds
+    GLfloat      frameTime;
+    int          overBudgetFrames;
+    int          underBudgetFrames;
+    /// Frames with headroom needed before the scale rises; doubles after every drop
+    int          riseFrames;
+    /// Frames since the last rise, -1 once it has held or after a drop
+    int          framesSinceRise;
+
+    /// GL_TRUE when frames are timed with EXT_disjoint_timer_query
+    GLboolean    timerQueries;
+    GLuint       queries[ES_RESOLUTION_QUERIES];
+    int          firstQuery;
+    int          numQueries;
+
+    GLuint       program;
+    GLuint       quadBuffer;
+    GLint        positionLoc;
+    ESReflection reflection;
+    /// Upscale uniforms, resolved once by esDynamicResolutionInit
+    ESShaderVariable *scaleUniform;
+    ESShaderVariable *maxTexCoordUniform;
+} ESDynamicResolution;
+
+///
+/// Plane a*x + b*y + c*z + d = 0, with (a, b, c) unit length pointing inside
+///
+typedef struct
+{
+    GLfloat   a, b, c, d;
+} ESPlane;
+
+///
+/// The six clip planes of a view frustum: left, right, bottom, top, near, far
+///
+typedef struct
+{
+    ESPlane   planes[6];
+} ESFrustumPlanes;
+
+///
+/// Structure-of-arrays bounding spheres for esCullSpheres
+///
+typedef struct
+{
+    const GLfloat *x, *y, *z;
+    const GLfloat *radius;
+} ESSphereArrays;
+
+///
+/// Structure-of-arrays axis aligned boxes (center and half extents) for esCullBoxes
+///
+typedef struct
+{
+    const GLfloat *cx, *cy, *cz;
+    const GLfloat *ex, *ey, *ez;
+} ESBoxArrays;
+
+/// Maximum number of tasks esTaskRun runs at once, and of esSceneUpdate threads
+#define ES_MAX_THREADS          8
+
+///
+/// Flat transform hierarchy, see esSceneInit.  Arrays are indexed by node
+/// and every parent index is lower than its children's.
+///
+typedef struct
+{
+    int            capacity;
+    int            count;
+
+    /// Parent node, -1 for roots
+    int           *parent;
+    /// Top-level ancestor, used to split updates by subtree
+    int           *root;
+    /// Dirty / changed-this-update flags
+    unsigned char *flags;
+
+    /// Local transform, edit through esSceneSetLocal
+    ESVec3        *position;
+    ESQuaternion  *rotation;
+    ESVec3        *scale;
+
+    /// World matrices, valid after esSceneUpdate
+    ESMatrix      *world;
+
+    /// Node indices grouped by update thread; thread t owns
+    /// order[ranges[t]] to order[ranges[t + 1] - 1]
+    int           *order;
+    int            ranges[ES_MAX_THREADS + 1];
+    /// Node and thread count the ranges were built for
+    int            rangeCount;
+    int            rangeThreads;
+} ESSceneTransforms;
+
 typedef struct _escontext
 {
    /// Put your user data here...
@@ -64,10 +564,24 @@ typedef struct _escontext
    void (ESCALLBACK *drawFunc) ( struct _escontext * );
    void (ESCALLBACK *keyFunc) ( struct _escontext *, unsigned char, int, int );
    void (ESCALLBACK *updateFunc) ( struct _escontext *, float deltaTime );
+   int  (ESCALLBACK *initFunc) ( struct _escontext * );
+
+   /// esCreateWindow flags in effect
+   GLuint      flags;
     
     float deltatime;
     float totaltime;
     unsigned int frames;
+
+    /// Fixed update step in seconds set by esSetFixedTimestep, 0 to update once per frame
+    float fixedstep;
+    /// Most fixed steps run in one frame; time beyond that is dropped
+    int   maxsteps;
+    /// Simulation time not yet consumed by fixed steps
+    float accumulator;
+    /// Fraction of a fixed step between the last update and this draw, for interpolating
+    /// between the previous and current simulation state; 1 without a fixed step
+    float alpha;
 } ESContext;
 
 
@@ -85,15 +599,28 @@ void ESUTIL_API esInitContext ( ESContext *esContext );
 ///         ES_WINDOW_DEPTH   - specifies that a depth buffer should be created
 ///         ES_WINDOW_STENCIL - specifies that a stencil buffer should be created
 ///         ES_WINDOW_MULTISAMPLE - specifies that a multi-sample buffer should be created
+///         ES_WINDOW_OFFSCREEN - create the context on a render thread in esMainLoop instead; all GL
+///                               work then belongs in the init, update and draw callbacks.
+///                               Ignored without pthreads.
 /// \return GL_TRUE if window creation is succesful, GL_FALSE otherwise
 GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char *title, GLint width, GLint height, GLuint flags );
 
 //
 /// \brief Start the main loop for the OpenGL ES application
+///        With ES_WINDOW_OFFSCREEN the loop and all callbacks run on a new render thread,
+///        and input events are forwarded to it from the main thread.
 /// \param esContext Application context
 //
 void ESUTIL_API esMainLoop ( ESContext *esContext );
 
+//
+/// \brief Register a callback that sets up GL resources once the context is current
+///        It runs at the start of esMainLoop, on the render thread with ES_WINDOW_OFFSCREEN.
+/// \param esContext Application context
+/// \param initFunc Init callback; returning 0 stops the main loop from starting
+//
+void ESUTIL_API esRegisterInitFunc ( ESContext *esContext, int (ESCALLBACK *initFunc) ( ESContext* ) );
+
 //
 /// \brief Register a draw callback function to be used to render each frame
 /// \param esContext Application context
@@ -108,6 +635,17 @@ void ESUTIL_API esRegisterDrawFunc ( ESContext *esContext, void (ESCALLBACK *dra
 //
 void ESUTIL_API esRegisterUpdateFunc ( ESContext *esContext, void (ESCALLBACK *updateFunc) ( ESContext*, float ) );
 
+//
+/// \brief Run the update callback at a fixed rate instead of once per frame.  Each frame runs
+///        as many steps as the elapsed time covers, possibly none, and the draw callback finds
+///        the leftover fraction of a step in esContext->alpha.
+/// \param esContext Application context
+/// \param step Seconds per update, e.g. 1.0f / 60.0f; 0 restores one variable update per frame
+/// \param maxSteps Most updates per frame.  When updates fall further behind, the extra time is
+///        dropped so a slow frame cannot cause ever more updates in the next one.
+//
+void ESUTIL_API esSetFixedTimestep ( ESContext *esContext, float step, int maxSteps );
+
 //
 /// \brief Register an keyboard input processing callback function
 /// \param esContext Application context
@@ -121,6 +659,13 @@ void ESUTIL_API esRegisterKeyFunc ( ESContext *esContext,
 //
 void ESUTIL_API esLogMessage ( const char *formatStr, ... );
 
+//
+/// \brief Check whether the current context exposes an extension
+/// \param name Extension name, e.g. "GL_OES_element_index_uint"; matched with or without the GL_ prefix
+/// \return GL_TRUE if the extension is listed in GL_EXTENSIONS
+//
+GLboolean ESUTIL_API esHasExtension ( const char *name );
+
 //
 ///
 /// \brief Load a shader, check for compile errors, print error messages to output log
@@ -140,6 +685,105 @@ GLuint ESUTIL_API esLoadShader ( GLenum type, const char *shaderSrc );
 //
 GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragShaderSrc );
 
+//
+/// \brief Keep programs built by esLoadProgram as GL_OES_get_program_binary blobs in files, so later
+///        runs load them instead of compiling.  Binaries are rebuilt when the GL vendor, renderer or
+///        version string changes.  Native builds only; does nothing on Emscripten.
+/// \param directory Existing directory for the binaries, or NULL to disable
+//
+void ESUTIL_API esProgramBinaryCachePersist ( const char *directory );
+
+//
+/// \brief Start building a program without waiting for the driver.  Compiles and links are only
+///        issued here; esProgramPoll checks them later.  Requests are deduplicated by a hash of the
+///        sources and attribute names.
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \param attribs NULL terminated attribute names bound to locations 0, 1, ..., or NULL
+/// \return The shared cache entry, NULL if the cache is full
+//
+const ESProgram * ESUTIL_API esProgramRequest ( const char *vertShaderSrc, const char *fragShaderSrc,
+                                                const char *const *attribs );
+
+//
+/// \brief Move requested programs whose compile and link finished to ES_PROGRAM_READY or ES_PROGRAM_FAILED,
+///        logging errors.  Never stalls with KHR_parallel_shader_compile; call once per frame.
+/// \return The number of programs still pending
+//
+int ESUTIL_API esProgramPoll ( void );
+
+//
+/// \brief Delete every program built by esProgramRequest
+//
+void ESUTIL_API esProgramCacheClear ( void );
+
+//
+/// \brief Set up a shader with optional features.  Nothing is compiled until a variant is requested.
+/// \param source The shader to initialize
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \param features NULL terminated feature names, at most 32, or NULL
+/// \param attribs NULL terminated attribute names bound to locations 0, 1, ..., or NULL
+/// \param uniforms NULL terminated uniform names resolved for every variant, or NULL
+//
+void ESUTIL_API esShaderSourceInit ( ESShaderSource *source, const char *vertShaderSrc, const char *fragShaderSrc,
+                                     const char *const *features, const char *const *attribs,
+                                     const char *const *uniforms );
+
+//
+/// \brief Get the variant of a shader with the features in mask enabled.  The first request for a
+///        mask starts building it with esProgramRequest; later ones are a hash table lookup.
+///        Locations are resolved once, when the program becomes ready.
+/// \param source The shader
+/// \param mask Bit i enables source->features[i]
+/// \return The variant, NULL while it is still building or if it failed
+//
+const ESShaderVariant * ESUTIL_API esShaderVariantGet ( const ESShaderSource *source, GLuint mask );
+
+//
+/// \brief Enumerate the active uniforms and attributes of a linked program
+/// \param reflection Filled in; free with esReflectionFree
+/// \param program A successfully linked program, e.g. from esLoadProgram
+/// \return GL_TRUE on success, GL_FALSE if allocation failed
+//
+GLboolean ESUTIL_API esReflectionInit ( ESReflection *reflection, GLuint program );
+
+//
+/// \brief Free the tables allocated by esReflectionInit.  The program is not deleted.
+//
+void ESUTIL_API esReflectionFree ( ESReflection *reflection );
+
+//
+/// \brief Forget the stored uniform values, so the next esSetUniform* call for each uniform reaches GL
+/// \param reflection The program whose uniforms were set directly, or NULL for every program, e.g. after
+///        glUniform* calls whose program is not known
+//
+void ESUTIL_API esReflectionInvalidate ( ESReflection *reflection );
+
+//
+/// \brief Look up an active uniform or attribute by name without calling GL
+/// \return The variable, NULL if the program has no such active uniform or attribute
+//
+ESShaderVariable * ESUTIL_API esReflectionUniform ( const ESReflection *reflection, const char *name );
+ESShaderVariable * ESUTIL_API esReflectionAttrib ( const ESReflection *reflection, const char *name );
+
+//
+/// \brief Set a uniform with the glUniform* call matching its type, skipping the call when the value
+///        equals the last one set.  The program is made current through esStateUseProgram if needed.
+///        Uniforms set with glUniform* directly must be followed by esReflectionInvalidate, or a later
+///        call with the value cached before them is skipped.
+/// \param uniform From esReflectionUniform on the same reflection; NULL is ignored
+/// \param count Number of array elements to set, starting at element 0
+/// \param value count elements of the uniform's type: floats for float, vector and matrix
+///        uniforms (esSetUniformfv), ints for int, bool and sampler uniforms (esSetUniformiv)
+//
+void ESUTIL_API esSetUniformfv ( ESReflection *reflection, const ESShaderVariable *uniform, GLsizei count,
+                                 const GLfloat *value );
+void ESUTIL_API esSetUniformiv ( ESReflection *reflection, const ESShaderVariable *uniform, GLsizei count,
+                                 const GLint *value );
+void ESUTIL_API esSetUniform1f ( ESReflection *reflection, const ESShaderVariable *uniform, GLfloat value );
+void ESUTIL_API esSetUniform1i ( ESReflection *reflection, const ESShaderVariable *uniform, GLint value );
+
 
 //
 /// \brief Generates geometry for a sphere.  Allocates memory for the vertex data and stores 
@@ -150,11 +794,70 @@ GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragSha
 /// \param texCoords If not NULL, will contain array of float2 texCoords
 /// \param indices If not NULL, will contain the array of indices for the triangle strip
 /// \return The number of indices required for rendering the buffers (the number of indices stored in the indices array
-///         if it is not NULL ) as a GL_TRIANGLE_STRIP
+///         if it is not NULL ) as a GL_TRIANGLE_STRIP.  0, with every requested array set to NULL, if indices
+///         is not NULL and numSlices is above 255, where 16-bit indices would wrap; use esGenSphereMesh for those.
 //
 int ESUTIL_API esGenSphere ( int numSlices, float radius, GLfloat **vertices, GLfloat **normals, 
                              GLfloat **texCoords, GLushort **indices );
 
+//
+/// \brief Report the buffer sizes esGenSphereInterleaved needs for a given tessellation
+/// \param numSlices The number of slices in the sphere
+/// \param vertexBytes If not NULL, returns the size of the interleaved vertex buffer in bytes
+/// \param indexBytes If not NULL, returns the size of the index buffer in bytes
+/// \return The number of indices
+//
+int ESUTIL_API esGenSphereInterleavedSize ( int numSlices, int *vertexBytes, int *indexBytes );
+
+//
+/// \brief Generates the same sphere as esGenSphere into caller-supplied memory, without allocating.
+///        Vertices are interleaved position, normal, texcoord (ES_INTERLEAVED_VERTEX_SIZE bytes each) and
+///        sin/cos are evaluated once per distinct angle rather than per vertex.
+/// \param numSlices The number of slices in the sphere
+/// \param radius Sphere radius
+/// \param vertices If not NULL, receives the interleaved vertices; size from esGenSphereInterleavedSize
+/// \param indices If not NULL, receives the GL_TRIANGLES index list; size from esGenSphereInterleavedSize
+/// \return The number of indices, or 0 if indices is not NULL and numSlices is above 255 (see esGenSphereMesh)
+//
+int ESUTIL_API esGenSphereInterleaved ( int numSlices, float radius, GLfloat *vertices, GLushort *indices );
+
+//
+/// \brief Generates an esGenSphere sphere of any tessellation without overflowing 16-bit indices
+///        With ES_MESH_UINT_INDICES the whole sphere is one sub-mesh, using GL_UNSIGNED_INT indices only once it
+///        exceeds 65536 vertices.  Without, large spheres are split into bands that each fit GL_UNSIGNED_SHORT.
+/// \param numSlices The number of slices in the sphere
+/// \param radius Sphere radius
+/// \param flags Bitfield of generation flags
+///         ES_MESH_UINT_INDICES - 32-bit indices may be used, i.e. esHasExtension("GL_OES_element_index_uint")
+///         ES_MESH_OPTIMIZE     - run esOptimizeMesh on the result
+/// \param mesh Returns the mesh, release with esFreeMesh
+/// \return The total number of indices.  0 if allocation failed, or if numSlices is below 1 or so large that
+///         a size would overflow an int: above 7662 slices when split into bands, 8190 with ES_MESH_UINT_INDICES.
+//
+int ESUTIL_API esGenSphereMesh ( int numSlices, float radius, GLuint flags, ESMesh *mesh );
+
+//
+/// \brief Free the memory allocated by esGenSphereMesh
+//
+void ESUTIL_API esFreeMesh ( ESMesh *mesh );
+
+//
+/// \brief Draw one sub-mesh of a mesh as GL_TRIANGLES, see esDrawMesh
+/// \param mesh Mesh to draw from
+/// \param subMesh Index of the sub-mesh, e.g. a level from esSelectLod
+/// \param positionLoc, normalLoc, texCoordLoc Attribute locations, -1 to skip
+//
+void ESUTIL_API esDrawSubMesh ( const ESMesh *mesh, int subMesh, GLint positionLoc, GLint normalLoc, GLint texCoordLoc );
+
+//
+/// \brief Draw all sub-meshes of a mesh as GL_TRIANGLES
+///        The mesh vertices and indices must be uploaded, unchanged, at offset 0 of the currently bound
+///        GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER, and the attribute arrays enabled.
+/// \param mesh Mesh to draw
+/// \param positionLoc, normalLoc, texCoordLoc Attribute locations, -1 to skip
+//
+void ESUTIL_API esDrawMesh ( const ESMesh *mesh, GLint positionLoc, GLint normalLoc, GLint texCoordLoc );
+
 //
 /// \brief Generates geometry for a cube.  Allocates memory for the vertex data and stores 
 ///        the results in the arrays.  Generate index list for a TRIANGLES
@@ -170,6 +873,426 @@ int ESUTIL_API esGenCube ( float scale, GLfloat **vertices, GLfloat **normals,
                            GLfloat **texCoords, GLushort **indices );
 
 
+//
+/// \brief Generate a chain of esGenSphereInterleaved spheres, e.g. 64/32/16/8 slices, in one allocation
+/// \param slices Slices per level, each at most 255 so every level fits 16-bit indices.  Levels may be in any
+///        order; esSelectLod compares slice counts, not level indices.
+/// \param numLevels Number of levels, at most ES_MAX_LOD_LEVELS
+/// \param radius Sphere radius
+/// \param chain Returns the chain; level i is chain->mesh.subMeshes[i].  Release with esFreeLodChain.
+/// \return The total number of indices, 0 on invalid arguments or allocation failure
+//
+int ESUTIL_API esGenSphereLodChain ( const int *slices, int numLevels, float radius, ESLodChain *chain );
+
+//
+/// \brief Free the memory allocated by esGenSphereLodChain
+//
+void ESUTIL_API esFreeLodChain ( ESLodChain *chain );
+
+//
+/// \brief Pick the coarsest level whose triangle edges stay under maxEdgePixels on screen
+/// \param chain Chain from esGenSphereLodChain
+/// \param distance Distance from the camera to the sphere center; divide by the instance scale for scaled instances
+/// \param fovy, viewportHeight The esPerspective field of view (degrees) and the viewport height in pixels
+/// \param maxEdgePixels Largest acceptable projected edge length, e.g. 8
+/// \return The level index to draw
+//
+int ESUTIL_API esSelectLod ( const ESLodChain *chain, float distance, float fovy, int viewportHeight, float maxEdgePixels );
+
+//
+/// \brief esSelectLod for count instances
+/// \param distances Per-instance camera distances
+/// \param levels Returns count level indices
+//
+void ESUTIL_API esSelectLodBatch ( const ESLodChain *chain, const GLfloat *distances, int count,
+                                   float fovy, int viewportHeight, float maxEdgePixels, int *levels );
+
+//
+/// \brief Describe the interleaved layout for a combination of ES_VERTEX_* format flags
+/// \param format Bitfield of ES_VERTEX_* flags, 0 for the 32 byte float layout of the esGen* functions
+/// \param layout Returns the stride and attribute descriptions.  layout->format leaves out
+///        ES_VERTEX_POSITION_HALF when the context has no OES_vertex_half_float.
+//
+void ESUTIL_API esVertexLayoutInit ( GLuint format, ESVertexLayout *layout );
+
+//
+/// \brief Pack interleaved float vertices (ES_INTERLEAVED_VERTEX_SIZE each, as from esGenSphereInterleaved
+///        or an ESMesh) into a compact interleaved stream
+/// \param format Bitfield of ES_VERTEX_* flags
+/// \param src Source vertices: position (3), normal (3), texcoord (2) floats
+/// \param numVertices Number of vertices
+/// \param dst Receives numVertices * layout->stride bytes
+/// \param layout Returns the layout of dst, including positionScale, texCoordScale and texCoordBias
+/// \return The number of bytes written to dst
+//
+int ESUTIL_API esPackVertices ( GLuint format, const GLfloat *src, int numVertices, void *dst, ESVertexLayout *layout );
+
+//
+/// \brief Point vertex attributes at a packed stream in the currently bound GL_ARRAY_BUFFER
+/// \param layout Layout from esPackVertices or esVertexLayoutInit
+/// \param positionLoc, normalLoc, texCoordLoc Attribute locations, -1 to skip
+/// \param baseOffset Byte offset of the first vertex in the buffer
+//
+void ESUTIL_API esVertexLayoutBind ( const ESVertexLayout *layout, GLint positionLoc, GLint normalLoc,
+                                     GLint texCoordLoc, GLsizei baseOffset );
+
+//
+/// \brief Get uploaded geometry for a shape, generating it only if no identical geometry is alive
+/// \param shape ES_SHAPE_SPHERE or ES_SHAPE_CUBE
+/// \param slices Sphere slices, ignored for cubes
+/// \param scale Sphere radius or cube size
+/// \param format Bitfield of ES_VERTEX_* flags for the vertex buffer
+/// \return Shared geometry with its reference count raised, release with esGeometryRelease.
+///         NULL if generation failed or the cache is full.
+//
+const ESGeometry * ESUTIL_API esGeometryAcquire ( int shape, int slices, float scale, GLuint format );
+
+//
+/// \brief Drop a reference from esGeometryAcquire, deleting the buffers when the last one goes
+//
+void ESUTIL_API esGeometryRelease ( const ESGeometry *geometry );
+
+//
+/// \brief Keep generated geometry in files so later runs skip generation and packing
+/// \param directory Existing directory such as the IDBFS mount "/working1", or NULL to disable.
+///        On Emscripten, new files reach IndexedDB on the next esGeometryCacheFlush.
+//
+void ESUTIL_API esGeometryCachePersist ( const char *directory );
+
+//
+/// \brief Push files written since the last call to IndexedDB with one FS.syncfs on the main thread.
+///        Does nothing if no file was written.  The main loop calls this after every frame.
+//
+void ESUTIL_API esGeometryCacheFlush ( void );
+
+//
+/// \brief Bind the buffers of a geometry and draw all of its sub-meshes as GL_TRIANGLES
+/// \param geometry Geometry from esGeometryAcquire
+/// \param positionLoc, normalLoc, texCoordLoc Attribute locations with enabled arrays, -1 to skip
+//
+void ESUTIL_API esDrawGeometry ( const ESGeometry *geometry, GLint positionLoc, GLint normalLoc, GLint texCoordLoc );
+
+//
+/// \brief Create the ring of streaming vertex buffers used by esStreamAlloc
+/// \param capacity Size in bytes of each buffer, and the largest single allocation
+/// \return GL_FALSE if allocation failed
+//
+GLboolean ESUTIL_API esStreamInit ( GLsizeiptr capacity );
+
+//
+/// \brief Delete the buffers created by esStreamInit
+//
+void ESUTIL_API esStreamShutdown ( void );
+
+//
+/// \brief Sub-allocate dynamic vertex data from the stream ring
+/// \param bytes Size of the allocation, at most the esStreamInit capacity
+/// \return Writable memory and where it will live on the GPU; ptr is NULL if the request can not be served.
+///         Fill ptr before the next esStreamAlloc or esStreamFlush.
+//
+ESStreamAlloc ESUTIL_API esStreamAlloc ( GLsizeiptr bytes );
+
+//
+/// \brief Upload everything allocated since the last flush.  Call before drawing from streamed data.
+///         Leaves the current stream buffer bound to GL_ARRAY_BUFFER.
+//
+void ESUTIL_API esStreamFlush ( void );
+
+//
+/// \brief Upload a mesh from esGenSphere or esGenCube for instanced drawing
+/// \param vertices, normals, texCoords, indices, numIndices The esGen* output; normals and texCoords may be NULL
+/// \param format ES_INSTANCE_MATRIX or ES_INSTANCE_TRS
+/// \param allowInstancedArrays GL_FALSE to force the uniform array path
+/// \return GL_FALSE on allocation failure or an empty mesh
+//
+GLboolean ESUTIL_API esInstancedMeshInit ( ESInstancedMesh *mesh, const GLfloat *vertices, const GLfloat *normals,
+                                           const GLfloat *texCoords, const GLushort *indices, int numIndices,
+                                           GLuint format, GLboolean allowInstancedArrays );
+
+//
+/// \brief Delete the buffers created by esInstancedMeshInit
+//
+void ESUTIL_API esInstancedMeshFree ( ESInstancedMesh *mesh );
+
+//
+/// \brief Look up the instancing attributes and uniforms in a program linked with mesh->shaderHeader
+//
+void ESUTIL_API esInstancedMeshSetProgram ( ESInstancedMesh *mesh, GLuint programObject );
+
+//
+/// \brief Draw count instances of a mesh with the program currently in use
+///         Instance data is streamed with esStreamAlloc on the instanced arrays path.
+/// \param instanceData count instances in the mesh format
+/// \param positionLoc, normalLoc, texCoordLoc Mesh attribute locations with enabled arrays, -1 to skip
+//
+void ESUTIL_API esDrawInstanced ( const ESInstancedMesh *mesh, const GLfloat *instanceData, int count,
+                                  GLint positionLoc, GLint normalLoc, GLint texCoordLoc );
+
+//
+/// \brief Forget the cached GL state, e.g. after calling GL directly or on a new context
+//
+void ESUTIL_API esStateInvalidate ( void );
+
+//
+/// \brief Get the number of GL calls issued and skipped by the esState* functions
+/// \param stats Returns the counters, may be NULL
+/// \param reset GL_TRUE to zero the counters afterwards, e.g. once per frame
+//
+void ESUTIL_API esStateGetStats ( ESStateStats *stats, GLboolean reset );
+
+//
+/// \brief Cached versions of the GL calls of the same name; each one is skipped if it would not change the state
+//
+void ESUTIL_API esStateUseProgram ( GLuint program );
+void ESUTIL_API esStateBindBuffer ( GLenum target, GLuint buffer );
+void ESUTIL_API esStateDeleteBuffers ( GLsizei n, const GLuint *buffers );
+void ESUTIL_API esStateDeleteProgram ( GLuint program );
+void ESUTIL_API esStateActiveTexture ( GLenum texture );
+void ESUTIL_API esStateBindTexture ( GLenum target, GLuint texture );
+void ESUTIL_API esStateVertexAttribPointer ( GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                             GLsizei stride, const void *pointer );
+void ESUTIL_API esStateEnableVertexAttribArray ( GLuint index );
+void ESUTIL_API esStateDisableVertexAttribArray ( GLuint index );
+void ESUTIL_API esStateEnable ( GLenum cap );
+void ESUTIL_API esStateDisable ( GLenum cap );
+void ESUTIL_API esStateBlendFunc ( GLenum sfactor, GLenum dfactor );
+void ESUTIL_API esStateBlendEquation ( GLenum mode );
+void ESUTIL_API esStateDepthFunc ( GLenum func );
+void ESUTIL_API esStateDepthMask ( GLboolean flag );
+void ESUTIL_API esStateViewport ( GLint x, GLint y, GLsizei width, GLsizei height );
+
+//
+/// \brief Pack a render queue sort key
+///         Fields are truncated to layer:4, program:10, material:12 and buffer:12 bits.
+/// \param layer Layers draw in increasing order, e.g. world before UI
+/// \param translucent GL_TRUE for blended items, which draw after opaque ones in their layer, back-to-front
+/// \param program, material, buffer Small ids of the state the item uses; equal ids are drawn together
+/// \param depth View depth normalized to [0, 1]; opaque items draw front-to-back within equal state
+//
+ESSortKey ESUTIL_API esMakeSortKey ( GLuint layer, GLboolean translucent, GLuint program,
+                                     GLuint material, GLuint buffer, float depth );
+
+//
+/// \brief Allocate a render queue for up to capacity items per frame
+/// \return GL_FALSE if allocation failed
+//
+GLboolean ESUTIL_API esRenderQueueInit ( ESRenderQueue *queue, int capacity );
+
+//
+/// \brief Free the memory allocated by esRenderQueueInit
+//
+void ESUTIL_API esRenderQueueFree ( ESRenderQueue *queue );
+
+//
+/// \brief Add a draw item to the queue
+/// \param key Sort key from esMakeSortKey
+/// \param program Program the queue makes current, through esStateUseProgram, before calling drawFunc
+/// \param drawFunc Callback issuing the draw, preferably with the esState* functions
+/// \param data Passed to drawFunc
+/// \return GL_FALSE if the queue is full
+//
+GLboolean ESUTIL_API esRenderQueuePush ( ESRenderQueue *queue, ESSortKey key, GLuint program,
+                                         void (ESCALLBACK *drawFunc) ( void * ), void *data );
+
+//
+/// \brief Radix sort the queued items by key
+//
+void ESUTIL_API esRenderQueueSort ( ESRenderQueue *queue );
+
+//
+/// \brief Sort and execute the queued items, then empty the queue
+///         Blending and depth writes are switched between opaque and translucent items.
+//
+void ESUTIL_API esRenderQueueSubmit ( ESRenderQueue *queue );
+
+//
+/// \brief Create a sprite batcher and its shared quad index buffer
+/// \param maxQuads Quads per draw call, at most 16384
+/// \return GL_FALSE on invalid size or allocation failure
+//
+GLboolean ESUTIL_API esSpriteBatchInit ( ESSpriteBatch *batch, int maxQuads );
+
+//
+/// \brief Free the memory and buffer allocated by esSpriteBatchInit
+//
+void ESUTIL_API esSpriteBatchFree ( ESSpriteBatch *batch );
+
+//
+/// \brief Start a frame of sprites, resetting the batch counter
+//
+void ESUTIL_API esSpriteBatchBegin ( ESSpriteBatch *batch );
+
+//
+/// \brief Select the program for following quads, flushing if it differs from the current one
+/// \param positionLoc, texCoordLoc, colorLoc Attribute locations for ESSpriteVertex, -1 to skip
+//
+void ESUTIL_API esSpriteBatchSetProgram ( ESSpriteBatch *batch, GLuint program, GLint positionLoc,
+                                          GLint texCoordLoc, GLint colorLoc );
+
+//
+/// \brief Add a quad with arbitrary corners, e.g. rotated
+/// \param texture GL_TEXTURE_2D bound to the active unit for this quad; a different texture flushes the batch
+/// \param positions, texCoords Four corners in order around the quad, two floats each
+/// \param color 0xRRGGBBAA
+//
+void ESUTIL_API esSpriteBatchDrawQuad ( ESSpriteBatch *batch, GLuint texture, const GLfloat *positions,
+                                        const GLfloat *texCoords, GLuint color );
+
+//
+/// \brief Add an axis aligned quad from (x, y) to (x + width, y + height) with texcoords (u0, v0) to (u1, v1)
+//
+void ESUTIL_API esSpriteBatchDraw ( ESSpriteBatch *batch, GLuint texture, GLfloat x, GLfloat y, GLfloat width, GLfloat height,
+                                    GLfloat u0, GLfloat v0, GLfloat u1, GLfloat v1, GLuint color );
+
+//
+/// \brief Draw the pending quads now
+//
+void ESUTIL_API esSpriteBatchFlush ( ESSpriteBatch *batch );
+
+//
+/// \brief Flush and finish the frame
+/// \return The number of draw calls since esSpriteBatchBegin
+//
+int ESUTIL_API esSpriteBatchEnd ( ESSpriteBatch *batch );
+
+//
+/// \brief Allocate a command buffer; recording into it never allocates
+/// \param capacity Size in bytes, roughly 16 to 32 bytes per command plus uniform data
+/// \return GL_FALSE if allocation failed
+//
+GLboolean ESUTIL_API esCommandBufferInit ( ESCommandBuffer *cb, int capacity );
+
+//
+/// \brief Free the memory allocated by esCommandBufferInit
+//
+void ESUTIL_API esCommandBufferFree ( ESCommandBuffer *cb );
+
+//
+/// \brief Discard the recorded commands
+//
+void ESUTIL_API esCommandBufferReset ( ESCommandBuffer *cb );
+
+//
+/// \brief Record a command, to be issued through the esState* function or GL call of the same name on replay.
+///         Recording may happen on any thread, one thread per buffer at a time.
+///         Buffer offsets replace client pointers; uniform arrays are copied into the buffer.
+/// \return GL_FALSE if the buffer is full, which also sets cb->overflow
+//
+GLboolean ESUTIL_API esCmdUseProgram ( ESCommandBuffer *cb, GLuint program );
+GLboolean ESUTIL_API esCmdBindBuffer ( ESCommandBuffer *cb, GLenum target, GLuint buffer );
+GLboolean ESUTIL_API esCmdBindTexture ( ESCommandBuffer *cb, GLenum unit, GLenum target, GLuint texture );
+GLboolean ESUTIL_API esCmdVertexAttribPointer ( ESCommandBuffer *cb, GLuint index, GLint size, GLenum type,
+                                                GLboolean normalized, GLsizei stride, GLsizeiptr offset );
+GLboolean ESUTIL_API esCmdEnableVertexAttribArray ( ESCommandBuffer *cb, GLuint index );
+GLboolean ESUTIL_API esCmdDisableVertexAttribArray ( ESCommandBuffer *cb, GLuint index );
+GLboolean ESUTIL_API esCmdEnable ( ESCommandBuffer *cb, GLenum cap );
+GLboolean ESUTIL_API esCmdDisable ( ESCommandBuffer *cb, GLenum cap );
+GLboolean ESUTIL_API esCmdBlendFunc ( ESCommandBuffer *cb, GLenum sfactor, GLenum dfactor );
+GLboolean ESUTIL_API esCmdDepthMask ( ESCommandBuffer *cb, GLboolean flag );
+GLboolean ESUTIL_API esCmdUniform1i ( ESCommandBuffer *cb, GLint location, GLint value );
+GLboolean ESUTIL_API esCmdUniform4fv ( ESCommandBuffer *cb, GLint location, GLsizei count, const GLfloat *value );
+GLboolean ESUTIL_API esCmdUniformMatrix4fv ( ESCommandBuffer *cb, GLint location, GLsizei count, const GLfloat *value );
+GLboolean ESUTIL_API esCmdDrawArrays ( ESCommandBuffer *cb, GLenum mode, GLint first, GLsizei count );
+GLboolean ESUTIL_API esCmdDrawElements ( ESCommandBuffer *cb, GLenum mode, GLsizei count, GLenum type, GLsizeiptr offset );
+
+//
+/// \brief Record a call to func(data) on the replaying thread, e.g. for GL work without an esCmd* function
+//
+GLboolean ESUTIL_API esCmdCallback ( ESCommandBuffer *cb, void (ESCALLBACK *func) ( void * ), void *data );
+
+//
+/// \brief Replay a command buffer on the thread that owns the GL context.  The buffer is left intact.
+//
+void ESUTIL_API esCommandBufferExecute ( const ESCommandBuffer *cb );
+
+//
+/// \brief Reset numThreads buffers and fill them concurrently, calling recordFunc(&buffers[t], t, data) on
+///         one thread each.  Returns when all are recorded; execute them afterwards in index order.
+/// \param numThreads Number of buffers and threads, at most ES_MAX_THREADS.  Runs on the esTaskRun pool.
+//
+void ESUTIL_API esCommandBufferRecordParallel ( ESCommandBuffer *buffers, int numThreads,
+                                                void (ESCALLBACK *recordFunc) ( ESCommandBuffer *, int, void * ),
+                                                void *data );
+
+//
+/// \brief Create the offscreen target, upscaling program and timer queries for dynamic resolution
+/// \param dr The controller to initialize
+/// \param targetTime Frame time to hold in seconds, e.g. 1.0f / 60.0f
+/// \param minScale Smallest fraction of the window resolution to render at, e.g. 0.5f
+/// \param depth GL_TRUE to give the offscreen target a depth buffer
+/// \return GL_TRUE on success
+//
+GLboolean ESUTIL_API esDynamicResolutionInit ( ESDynamicResolution *dr, float targetTime, float minScale,
+                                               GLboolean depth );
+
+//
+/// \brief Delete the GL objects created by esDynamicResolutionInit
+//
+void ESUTIL_API esDynamicResolutionFree ( ESDynamicResolution *dr );
+
+//
+/// \brief Start a frame: resize the target to the window if needed, bind it, set the viewport to
+///        renderWidth x renderHeight and start timing
+/// \param esContext Provides the window size and, without timer queries, the frame interval
+//
+void ESUTIL_API esDynamicResolutionBegin ( ESDynamicResolution *dr, ESContext *esContext );
+
+//
+/// \brief Finish a frame: stop timing, upscale the rendered part of the target to the window and
+///        adjust the scale for the following frames from the completed timings.  Leaves the default
+///        framebuffer bound, with depth test and blending disabled.
+//
+void ESUTIL_API esDynamicResolutionEnd ( ESDynamicResolution *dr, ESContext *esContext );
+
+//
+/// \brief Simulate a FIFO post-transform vertex cache over an index buffer
+/// \param indices GL_TRIANGLES index list
+/// \param indexType GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+/// \param numIndices, numVertices Sizes of the index list and of the vertex range it references
+/// \param cacheSize Number of cache entries, e.g. ES_VERTEX_CACHE_SIZE
+/// \return Average cache miss ratio: transformed vertices per triangle, 0.5 at best and 3 at worst
+//
+float ESUTIL_API esMeshACMR ( const void *indices, GLenum indexType, int numIndices, int numVertices, int cacheSize );
+
+//
+/// \brief Reorder triangles in place for the post-transform vertex cache (Tipsify)
+/// \param indices GL_TRIANGLES index list, rewritten in place
+/// \param indexType GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+/// \param numIndices, numVertices Sizes of the index list and of the vertex range it references
+/// \param cacheSize Number of cache entries to optimize for
+/// \return GL_TRUE on success, GL_FALSE if allocation failed (indices are left unchanged)
+//
+GLboolean ESUTIL_API esOptimizeVertexCache ( void *indices, GLenum indexType, int numIndices, int numVertices, int cacheSize );
+
+//
+/// \brief Renumber vertices in order of first use so vertex fetch walks memory linearly
+/// \param indices Index list, rewritten in place to the new numbering
+/// \param indexType GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+/// \param numIndices, numVertices Sizes of the index list and of the vertex range it references
+/// \param remap Returns numVertices entries, old vertex index -> new vertex index; pass to esRemapVertices
+///        for every vertex array the indices refer to
+//
+void ESUTIL_API esOptimizeVertexFetch ( void *indices, GLenum indexType, int numIndices, int numVertices, GLuint *remap );
+
+//
+/// \brief Move vertices to the positions given by a remap table from esOptimizeVertexFetch
+/// \param vertices Vertex array, permuted in place
+/// \param numVertices Number of vertices
+/// \param stride Size of one vertex in bytes
+/// \param remap Old vertex index -> new vertex index
+/// \return GL_TRUE on success, GL_FALSE if allocation failed
+//
+GLboolean ESUTIL_API esRemapVertices ( void *vertices, int numVertices, int stride, const GLuint *remap );
+
+//
+/// \brief Optimize every sub-mesh of a mesh for the vertex cache, then for vertex fetch
+/// \param mesh Mesh from esGenSphereMesh, modified in place
+/// \param cacheSize Number of cache entries to optimize for, e.g. ES_VERTEX_CACHE_SIZE
+/// \param acmrBefore, acmrAfter If not NULL, return the mesh ACMR before and after optimization
+/// \return GL_TRUE on success, GL_FALSE if allocation failed
+//
+GLboolean ESUTIL_API esOptimizeMesh ( ESMesh *mesh, int cacheSize, float *acmrBefore, float *acmrAfter );
+
 //
 /// \brief multiply matrix specified by result with a scaling matrix and return new matrix in result
 /// \param result Specifies the input matrix.  Scaled matrix is returned in result.
@@ -227,6 +1350,175 @@ void ESUTIL_API esOrtho(ESMatrix *result, float left, float right, float bottom,
 //
 void ESUTIL_API esMatrixMultiply(ESMatrix *result, ESMatrix *srcA, ESMatrix *srcB);
 
+//
+/// \brief perform result[i] = a[i] * b[i] for count contiguous matrix pairs
+///        Uses the SSE or wasm simd128 kernel when the compiler targets it.
+/// \param out Returns count multiplied matrices, may alias a or b
+/// \param a, b Arrays of count input matrices
+/// \param count Number of matrices in each array
+//
+void ESUTIL_API esMatrixMultiplyBatch(ESMatrix *out, const ESMatrix *a, const ESMatrix *b, int count);
+
+//
+/// \brief invert a general 4x4 matrix
+/// \param result Returns the inverse, may be the same matrix as src
+/// \param src Matrix to invert
+/// \return GL_TRUE on success, GL_FALSE if src is singular (result is left unchanged)
+//
+GLboolean ESUTIL_API esMatrixInverse(ESMatrix *result, const ESMatrix *src);
+
+//
+/// \brief invert an affine matrix, i.e. one built only from esTranslate, esRotate and esScale
+///        Cheaper than esMatrixInverse, but assumes m[0][3], m[1][3], m[2][3] are 0 and m[3][3] is 1.
+/// \param result Returns the inverse, may be the same matrix as src
+/// \param src Affine matrix to invert
+/// \return GL_TRUE on success, GL_FALSE if src is singular (result is left unchanged)
+//
+GLboolean ESUTIL_API esMatrixInverseAffine(ESMatrix *result, const ESMatrix *src);
+
+//
+/// \brief compute the normal matrix (inverse-transpose of the upper 3x3) of a model or modelview matrix
+/// \param result Returns the normal matrix, ready for glUniformMatrix3fv
+/// \param src Model or modelview matrix
+/// \return GL_TRUE on success, GL_FALSE if the upper 3x3 of src is singular
+//
+GLboolean ESUTIL_API esMatrixNormal(ESMatrix3 *result, const ESMatrix *src);
+
+//
+/// \brief esMatrixInverse over count contiguous matrices
+/// \return The number of matrices that were inverted; singular ones leave out[i] unchanged
+//
+int ESUTIL_API esMatrixInverseBatch(ESMatrix *out, const ESMatrix *in, int count);
+
+//
+/// \brief esMatrixInverseAffine over count contiguous matrices
+/// \return The number of matrices that were inverted; singular ones leave out[i] unchanged
+//
+int ESUTIL_API esMatrixInverseAffineBatch(ESMatrix *out, const ESMatrix *in, int count);
+
+//
+/// \brief esMatrixNormal over count contiguous matrices
+/// \return The number of matrices that were inverted; singular ones leave out[i] unchanged
+//
+int ESUTIL_API esMatrixNormalBatch(ESMatrix3 *out, const ESMatrix *in, int count);
+
+//
+/// \brief make a unit quaternion that rotates like esRotate with the same arguments
+/// \param result Returns the quaternion
+/// \param angle Specifies the angle of rotation, in degrees.
+/// \param x, y, z Specify the rotation axis, need not be normalized
+//
+void ESUTIL_API esQuaternionFromAxisAngle(ESQuaternion *result, GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+
+//
+/// \brief Hamilton product result = a * b.  esRotate by a followed by esRotate by b rotates like b * a.
+/// \param result Returns the product, may alias a or b
+//
+void ESUTIL_API esQuaternionMultiply(ESQuaternion *result, const ESQuaternion *a, const ESQuaternion *b);
+
+//
+/// \brief scale q to unit length, e.g. after accumulating many esQuaternionMultiply calls
+//
+void ESUTIL_API esQuaternionNormalize(ESQuaternion *q);
+
+//
+/// \brief build a model matrix directly from translation, rotation and scale
+///        Equivalent to esMatrixLoadIdentity, esTranslate, esRotate, esScale in that order,
+///        without the intermediate matrix multiplies or trigonometry.
+/// \param result Returns the model matrix
+/// \param pos Translation
+/// \param rot Unit quaternion rotation
+/// \param scale Scale factors along the x, y and z axes
+//
+void ESUTIL_API esComposeTRS(ESMatrix *result, const ESVec3 *pos, const ESQuaternion *rot, const ESVec3 *scale);
+
+//
+/// \brief esComposeTRS for count objects stored as structure-of-arrays
+/// \param out Returns count model matrices
+/// \param trs Arrays of positions, unit quaternions and scales, count entries each
+/// \param count Number of objects
+//
+void ESUTIL_API esComposeTRSBatch(ESMatrix *out, const ESTransformArrays *trs, int count);
+
+//
+/// \brief extract the six normalized frustum planes from a view-projection matrix
+/// \param frustum Returns the planes, in world space if viewProj is projection * view
+/// \param viewProj Combined matrix, e.g. built with esPerspective or esFrustum followed by the view transform
+//
+void ESUTIL_API esFrustumPlanesFromMatrix(ESFrustumPlanes *frustum, const ESMatrix *viewProj);
+
+//
+/// \brief test count bounding spheres against a frustum, four at a time
+/// \param frustum Planes from esFrustumPlanesFromMatrix
+/// \param spheres Sphere centers and radii, count entries each
+/// \param count Number of spheres
+/// \param visible Returns the indices of spheres that intersect the frustum, in order.
+///        Must have room for count entries.
+/// \return The number of indices written to visible
+//
+int ESUTIL_API esCullSpheres(const ESFrustumPlanes *frustum, const ESSphereArrays *spheres, int count, int *visible);
+
+//
+/// \brief test count axis aligned boxes against a frustum, four at a time
+/// \param frustum Planes from esFrustumPlanesFromMatrix
+/// \param boxes Box centers and half extents, count entries each
+/// \param count Number of boxes
+/// \param visible Returns the indices of boxes that intersect the frustum, in order.
+///        Must have room for count entries.
+/// \return The number of indices written to visible
+//
+int ESUTIL_API esCullBoxes(const ESFrustumPlanes *frustum, const ESBoxArrays *boxes, int count, int *visible);
+
+//
+/// \brief allocate a transform hierarchy with room for capacity nodes
+/// \param scene Hierarchy to initialize
+/// \param capacity Maximum number of nodes
+/// \return GL_TRUE on success, GL_FALSE if allocation failed
+//
+GLboolean ESUTIL_API esSceneInit(ESSceneTransforms *scene, int capacity);
+
+//
+/// \brief free the arrays allocated by esSceneInit
+//
+void ESUTIL_API esSceneFree(ESSceneTransforms *scene);
+
+//
+/// \brief append a node with an identity local transform
+/// \param scene Hierarchy to add to
+/// \param parent Index of an existing node, or -1 for a root
+/// \return The new node index, or -1 if the hierarchy is full or parent is invalid
+//
+int ESUTIL_API esSceneAddNode(ESSceneTransforms *scene, int parent);
+
+//
+/// \brief set the local translation, rotation and scale of a node and mark it dirty
+/// \param scene Hierarchy containing the node
+/// \param node Node index
+/// \param pos, rot, scale New local transform; NULL leaves that component unchanged
+//
+void ESUTIL_API esSceneSetLocal(ESSceneTransforms *scene, int node, const ESVec3 *pos,
+                                const ESQuaternion *rot, const ESVec3 *scale);
+
+//
+/// \brief recompute world matrices of dirty nodes and their descendants
+/// \param scene Hierarchy to update
+/// \param numThreads Number of threads to split root subtrees across, 1 to update on the calling thread.
+///        Work runs on the esTaskRun worker pool.
+/// \return The number of world matrices that were recomputed
+//
+int ESUTIL_API esSceneUpdate(ESSceneTransforms *scene, int numThreads);
+
+//
+/// \brief run func(task, data) for every task in [0, numTasks) on a persistent worker pool
+/// \param numTasks Number of tasks, at most ES_MAX_THREADS.  Task 0 runs on the calling thread.
+/// \param func Task function, called once per task index
+/// \param data Passed to func
+/// \remark Workers are started on first use and kept alive.  Returns when every task has finished.
+///         A call from inside a task, e.g. esSceneUpdate from an esCommandBufferRecordParallel
+///         recordFunc, runs all of its tasks in order on the calling thread.
+//
+void ESUTIL_API esTaskRun(int numTasks, void (ESCALLBACK *func)(int task, void *data), void *data);
+
 //
 //// \brief return an indentity matrix 
 //// \param result returns identity matrix
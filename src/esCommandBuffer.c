@@ -0,0 +1,401 @@
+// esCommandBuffer.c
+//
+//    Recorded GL commands.  Any thread can record draw commands into its
+//    own ESCommandBuffer; recording only appends to memory allocated up
+//    front, so it takes no locks and never allocates.  The thread owning
+//    the GL context then replays the buffers in order.  Replay goes through
+//    the esState* functions, so state repeated across commands or buffers
+//    costs no GL calls.
+//
+//    Each command is a CommandHeader followed by its payload, padded to
+//    4 bytes.  Payloads are copied in and out with memcpy, so pointers and
+//    floats in them need no particular alignment.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+   CMD_USE_PROGRAM = 1,
+   CMD_BIND_BUFFER,
+   CMD_BIND_TEXTURE,
+   CMD_VERTEX_ATTRIB_POINTER,
+   CMD_ENABLE_VERTEX_ATTRIB_ARRAY,
+   CMD_DISABLE_VERTEX_ATTRIB_ARRAY,
+   CMD_ENABLE,
+   CMD_DISABLE,
+   CMD_BLEND_FUNC,
+   CMD_DEPTH_MASK,
+   CMD_UNIFORM1I,
+   CMD_UNIFORM4FV,
+   CMD_UNIFORM_MATRIX4FV,
+   CMD_DRAW_ARRAYS,
+   CMD_DRAW_ELEMENTS,
+   CMD_CALLBACK
+};
+
+typedef struct
+{
+   unsigned short  opcode;
+   unsigned short  size;
+} CommandHeader;
+
+typedef struct
+{
+   GLuint      index;
+   GLint       size;
+   GLenum      type;
+   GLboolean   normalized;
+   GLsizei     stride;
+   GLsizeiptr  offset;
+} AttribPointerCmd;
+
+typedef struct
+{
+   GLenum      mode;
+   GLsizei     count;
+   GLenum      type;
+   GLsizeiptr  offset;
+} DrawElementsCmd;
+
+typedef struct
+{
+   void       (ESCALLBACK *func) ( void * );
+   void       *data;
+} CallbackCmd;
+
+typedef struct
+{
+   ESCommandBuffer  *buffers;
+   void             (ESCALLBACK *recordFunc) ( ESCommandBuffer *, int, void * );
+   void             *data;
+} RecordJob;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+//
+// Reserve a command and copy in up to two payload parts, e.g. a fixed
+// part and an array
+//
+static GLboolean record ( ESCommandBuffer *cb, int opcode, const void *a, int sizeA, const void *b, int sizeB )
+{
+   CommandHeader header;
+   int size = ( (int)sizeof(CommandHeader) + sizeA + sizeB + 3 ) & ~3;
+
+   if ( cb->size + size > cb->capacity || size > 0xFFFF )
+   {
+      cb->overflow = GL_TRUE;
+      return GL_FALSE;
+   }
+
+   header.opcode = (unsigned short)opcode;
+   header.size = (unsigned short)size;
+   memcpy ( cb->data + cb->size, &header, sizeof(CommandHeader) );
+   if ( sizeA > 0 )
+      memcpy ( cb->data + cb->size + sizeof(CommandHeader), a, sizeA );
+   if ( sizeB > 0 )
+      memcpy ( cb->data + cb->size + sizeof(CommandHeader) + sizeA, b, sizeB );
+
+   cb->size += size;
+   return GL_TRUE;
+}
+
+static GLboolean recordUints ( ESCommandBuffer *cb, int opcode, GLuint a, GLuint b, GLuint c )
+{
+   GLuint args[3];
+
+   args[0] = a;
+   args[1] = b;
+   args[2] = c;
+   return record ( cb, opcode, args, sizeof(args), NULL, 0 );
+}
+
+static void ESCALLBACK recordTask ( int thread, void *arg )
+{
+   RecordJob *job = (RecordJob *)arg;
+
+   job->recordFunc ( &job->buffers[thread], thread, job->data );
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+GLboolean ESUTIL_API esCommandBufferInit ( ESCommandBuffer *cb, int capacity )
+{
+   memset ( cb, 0, sizeof(ESCommandBuffer) );
+
+   cb->data = (unsigned char *)malloc ( capacity );
+   if ( cb->data == NULL )
+      return GL_FALSE;
+
+   cb->capacity = capacity;
+   return GL_TRUE;
+}
+
+void ESUTIL_API esCommandBufferFree ( ESCommandBuffer *cb )
+{
+   free ( cb->data );
+   memset ( cb, 0, sizeof(ESCommandBuffer) );
+}
+
+void ESUTIL_API esCommandBufferReset ( ESCommandBuffer *cb )
+{
+   cb->size = 0;
+   cb->overflow = GL_FALSE;
+}
+
+GLboolean ESUTIL_API esCmdUseProgram ( ESCommandBuffer *cb, GLuint program )
+{
+   return recordUints ( cb, CMD_USE_PROGRAM, program, 0, 0 );
+}
+
+GLboolean ESUTIL_API esCmdBindBuffer ( ESCommandBuffer *cb, GLenum target, GLuint buffer )
+{
+   return recordUints ( cb, CMD_BIND_BUFFER, target, buffer, 0 );
+}
+
+GLboolean ESUTIL_API esCmdBindTexture ( ESCommandBuffer *cb, GLenum unit, GLenum target, GLuint texture )
+{
+   return recordUints ( cb, CMD_BIND_TEXTURE, unit, target, texture );
+}
+
+GLboolean ESUTIL_API esCmdVertexAttribPointer ( ESCommandBuffer *cb, GLuint index, GLint size, GLenum type,
+                                                GLboolean normalized, GLsizei stride, GLsizeiptr offset )
+{
+   AttribPointerCmd cmd;
+
+   cmd.index = index;
+   cmd.size = size;
+   cmd.type = type;
+   cmd.normalized = normalized;
+   cmd.stride = stride;
+   cmd.offset = offset;
+   return record ( cb, CMD_VERTEX_ATTRIB_POINTER, &cmd, sizeof(cmd), NULL, 0 );
+}
+
+GLboolean ESUTIL_API esCmdEnableVertexAttribArray ( ESCommandBuffer *cb, GLuint index )
+{
+   return recordUints ( cb, CMD_ENABLE_VERTEX_ATTRIB_ARRAY, index, 0, 0 );
+}
+
+GLboolean ESUTIL_API esCmdDisableVertexAttribArray ( ESCommandBuffer *cb, GLuint index )
+{
+   return recordUints ( cb, CMD_DISABLE_VERTEX_ATTRIB_ARRAY, index, 0, 0 );
+}
+
+GLboolean ESUTIL_API esCmdEnable ( ESCommandBuffer *cb, GLenum cap )
+{
+   return recordUints ( cb, CMD_ENABLE, cap, 0, 0 );
+}
+
+GLboolean ESUTIL_API esCmdDisable ( ESCommandBuffer *cb, GLenum cap )
+{
+   return recordUints ( cb, CMD_DISABLE, cap, 0, 0 );
+}
+
+GLboolean ESUTIL_API esCmdBlendFunc ( ESCommandBuffer *cb, GLenum sfactor, GLenum dfactor )
+{
+   return recordUints ( cb, CMD_BLEND_FUNC, sfactor, dfactor, 0 );
+}
+
+GLboolean ESUTIL_API esCmdDepthMask ( ESCommandBuffer *cb, GLboolean flag )
+{
+   return recordUints ( cb, CMD_DEPTH_MASK, flag, 0, 0 );
+}
+
+GLboolean ESUTIL_API esCmdUniform1i ( ESCommandBuffer *cb, GLint location, GLint value )
+{
+   return recordUints ( cb, CMD_UNIFORM1I, (GLuint)location, (GLuint)value, 0 );
+}
+
+GLboolean ESUTIL_API esCmdUniform4fv ( ESCommandBuffer *cb, GLint location, GLsizei count, const GLfloat *value )
+{
+   GLint args[2];
+
+   args[0] = location;
+   args[1] = count;
+   return record ( cb, CMD_UNIFORM4FV, args, sizeof(args), value, count * 4 * sizeof(GLfloat) );
+}
+
+GLboolean ESUTIL_API esCmdUniformMatrix4fv ( ESCommandBuffer *cb, GLint location, GLsizei count, const GLfloat *value )
+{
+   GLint args[2];
+
+   args[0] = location;
+   args[1] = count;
+   return record ( cb, CMD_UNIFORM_MATRIX4FV, args, sizeof(args), value, count * 16 * sizeof(GLfloat) );
+}
+
+GLboolean ESUTIL_API esCmdDrawArrays ( ESCommandBuffer *cb, GLenum mode, GLint first, GLsizei count )
+{
+   return recordUints ( cb, CMD_DRAW_ARRAYS, mode, (GLuint)first, (GLuint)count );
+}
+
+GLboolean ESUTIL_API esCmdDrawElements ( ESCommandBuffer *cb, GLenum mode, GLsizei count, GLenum type, GLsizeiptr offset )
+{
+   DrawElementsCmd cmd;
+
+   cmd.mode = mode;
+   cmd.count = count;
+   cmd.type = type;
+   cmd.offset = offset;
+   return record ( cb, CMD_DRAW_ELEMENTS, &cmd, sizeof(cmd), NULL, 0 );
+}
+
+GLboolean ESUTIL_API esCmdCallback ( ESCommandBuffer *cb, void (ESCALLBACK *func) ( void * ), void *data )
+{
+   CallbackCmd cmd;
+
+   cmd.func = func;
+   cmd.data = data;
+   return record ( cb, CMD_CALLBACK, &cmd, sizeof(cmd), NULL, 0 );
+}
+
+void ESUTIL_API esCommandBufferExecute ( const ESCommandBuffer *cb )
+{
+   int pos = 0;
+
+   while ( pos < cb->size )
+   {
+      const unsigned char *payload = cb->data + pos + sizeof(CommandHeader);
+      CommandHeader header;
+      GLuint u[3];
+      GLint count[2];
+
+      memcpy ( &header, cb->data + pos, sizeof(CommandHeader) );
+
+      switch ( header.opcode )
+      {
+         case CMD_USE_PROGRAM:
+            memcpy ( u, payload, sizeof(u) );
+            esStateUseProgram ( u[0] );
+            break;
+
+         case CMD_BIND_BUFFER:
+            memcpy ( u, payload, sizeof(u) );
+            esStateBindBuffer ( u[0], u[1] );
+            break;
+
+         case CMD_BIND_TEXTURE:
+            memcpy ( u, payload, sizeof(u) );
+            esStateActiveTexture ( u[0] );
+            esStateBindTexture ( u[1], u[2] );
+            break;
+
+         case CMD_VERTEX_ATTRIB_POINTER:
+         {
+            AttribPointerCmd cmd;
+            memcpy ( &cmd, payload, sizeof(cmd) );
+            esStateVertexAttribPointer ( cmd.index, cmd.size, cmd.type, cmd.normalized, cmd.stride,
+                                         (char *)0 + cmd.offset );
+            break;
+         }
+
+         case CMD_ENABLE_VERTEX_ATTRIB_ARRAY:
+            memcpy ( u, payload, sizeof(u) );
+            esStateEnableVertexAttribArray ( u[0] );
+            break;
+
+         case CMD_DISABLE_VERTEX_ATTRIB_ARRAY:
+            memcpy ( u, payload, sizeof(u) );
+            esStateDisableVertexAttribArray ( u[0] );
+            break;
+
+         case CMD_ENABLE:
+            memcpy ( u, payload, sizeof(u) );
+            esStateEnable ( u[0] );
+            break;
+
+         case CMD_DISABLE:
+            memcpy ( u, payload, sizeof(u) );
+            esStateDisable ( u[0] );
+            break;
+
+         case CMD_BLEND_FUNC:
+            memcpy ( u, payload, sizeof(u) );
+            esStateBlendFunc ( u[0], u[1] );
+            break;
+
+         case CMD_DEPTH_MASK:
+            memcpy ( u, payload, sizeof(u) );
+            esStateDepthMask ( (GLboolean)u[0] );
+            break;
+
+         case CMD_UNIFORM1I:
+            memcpy ( u, payload, sizeof(u) );
+            glUniform1i ( (GLint)u[0], (GLint)u[1] );
+            esReflectionInvalidate ( NULL );
+            break;
+
+         case CMD_UNIFORM4FV:
+         case CMD_UNIFORM_MATRIX4FV:
+         {
+            // The array follows the two ints, 4-byte aligned as the command itself
+            const GLfloat *value = (const GLfloat *)( payload + sizeof(count) );
+            memcpy ( count, payload, sizeof(count) );
+            if ( header.opcode == CMD_UNIFORM4FV )
+               glUniform4fv ( count[0], count[1], value );
+            else
+               glUniformMatrix4fv ( count[0], count[1], GL_FALSE, value );
+            esReflectionInvalidate ( NULL );
+            break;
+         }
+
+         case CMD_DRAW_ARRAYS:
+            memcpy ( u, payload, sizeof(u) );
+            glDrawArrays ( u[0], (GLint)u[1], (GLsizei)u[2] );
+            break;
+
+         case CMD_DRAW_ELEMENTS:
+         {
+            DrawElementsCmd cmd;
+            memcpy ( &cmd, payload, sizeof(cmd) );
+            glDrawElements ( cmd.mode, cmd.count, cmd.type, (char *)0 + cmd.offset );
+            break;
+         }
+
+         case CMD_CALLBACK:
+         {
+            CallbackCmd cmd;
+            memcpy ( &cmd, payload, sizeof(cmd) );
+            cmd.func ( cmd.data );
+            break;
+         }
+      }
+
+      pos += header.size;
+   }
+}
+
+void ESUTIL_API esCommandBufferRecordParallel ( ESCommandBuffer *buffers, int numThreads,
+                                                void (ESCALLBACK *recordFunc) ( ESCommandBuffer *, int, void * ),
+                                                void *data )
+{
+   RecordJob job;
+   int       t;
+
+   if ( numThreads > ES_MAX_THREADS )
+      numThreads = ES_MAX_THREADS;
+
+   for ( t = 0; t < numThreads; t++ )
+      esCommandBufferReset ( &buffers[t] );
+
+   job.buffers = buffers;
+   job.recordFunc = recordFunc;
+   job.data = data;
+
+   // The calling thread records buffer 0 while the pool workers record the rest
+   esTaskRun ( numThreads, recordTask, &job );
+}
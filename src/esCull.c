@@ -0,0 +1,175 @@
+// esCull.c
+//
+//    View frustum plane extraction and batch visibility tests for bounding
+//    spheres and boxes.  Bounds are passed as structure-of-arrays so four
+//    objects can be tested per SIMD iteration.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <math.h>
+#include "esSimd.h"
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static void setPlane(ESPlane *plane, GLfloat a, GLfloat b, GLfloat c, GLfloat d)
+{
+    GLfloat mag = sqrtf(a * a + b * b + c * c);
+
+    if ( mag > 0.0f )
+        mag = 1.0f / mag;
+
+    plane->a = a * mag;
+    plane->b = b * mag;
+    plane->c = c * mag;
+    plane->d = d * mag;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+void ESUTIL_API esFrustumPlanesFromMatrix(ESFrustumPlanes *frustum, const ESMatrix *viewProj)
+{
+    // ESMatrix is uploaded untransposed, so clip-space row r of the
+    // matrix GL sees is column r here (Gribb/Hartmann extraction).
+    const GLfloat (*m)[4] = viewProj->m;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        setPlane(&frustum->planes[i * 2 + 0],
+                 m[0][3] + m[0][i], m[1][3] + m[1][i], m[2][3] + m[2][i], m[3][3] + m[3][i]);
+        setPlane(&frustum->planes[i * 2 + 1],
+                 m[0][3] - m[0][i], m[1][3] - m[1][i], m[2][3] - m[2][i], m[3][3] - m[3][i]);
+    }
+}
+
+int ESUTIL_API esCullSpheres(const ESFrustumPlanes *frustum, const ESSphereArrays *spheres, int count, int *visible)
+{
+    int numVisible = 0;
+    int i = 0, p;
+
+#ifdef ES_SIMD
+    esVec4 zero = VEC4_SPLAT(0.0f);
+
+    for ( ; i + 4 <= count; i += 4)
+    {
+        esVec4 x = VEC4_LOAD(spheres->x + i);
+        esVec4 y = VEC4_LOAD(spheres->y + i);
+        esVec4 z = VEC4_LOAD(spheres->z + i);
+        esVec4 r = VEC4_LOAD(spheres->radius + i);
+        int    mask = 0xF;
+
+        for (p = 0; p < 6 && mask; p++)
+        {
+            const ESPlane *plane = &frustum->planes[p];
+            esVec4 dist = VEC4_ADD(VEC4_MUL(VEC4_SPLAT(plane->a), x),
+                          VEC4_ADD(VEC4_MUL(VEC4_SPLAT(plane->b), y),
+                          VEC4_ADD(VEC4_MUL(VEC4_SPLAT(plane->c), z),
+                                   VEC4_ADD(VEC4_SPLAT(plane->d), r))));
+            mask &= VEC4_MOVEMASK(VEC4_CMPGE(dist, zero));
+        }
+
+        // Branch-free compaction of the surviving lanes
+        visible[numVisible] = i + 0; numVisible += (mask >> 0) & 1;
+        visible[numVisible] = i + 1; numVisible += (mask >> 1) & 1;
+        visible[numVisible] = i + 2; numVisible += (mask >> 2) & 1;
+        visible[numVisible] = i + 3; numVisible += (mask >> 3) & 1;
+    }
+#endif
+
+    for ( ; i < count; i++)
+    {
+        int inside = 1;
+
+        for (p = 0; p < 6 && inside; p++)
+        {
+            const ESPlane *plane = &frustum->planes[p];
+            inside = plane->a * spheres->x[i] + plane->b * spheres->y[i] +
+                     plane->c * spheres->z[i] + plane->d + spheres->radius[i] >= 0.0f;
+        }
+
+        visible[numVisible] = i;
+        numVisible += inside;
+    }
+
+    return numVisible;
+}
+
+int ESUTIL_API esCullBoxes(const ESFrustumPlanes *frustum, const ESBoxArrays *boxes, int count, int *visible)
+{
+    GLfloat absA[6], absB[6], absC[6];
+    int numVisible = 0;
+    int i = 0, p;
+
+    for (p = 0; p < 6; p++)
+    {
+        absA[p] = fabsf(frustum->planes[p].a);
+        absB[p] = fabsf(frustum->planes[p].b);
+        absC[p] = fabsf(frustum->planes[p].c);
+    }
+
+#ifdef ES_SIMD
+    {
+        esVec4 zero = VEC4_SPLAT(0.0f);
+
+        for ( ; i + 4 <= count; i += 4)
+        {
+            esVec4 cx = VEC4_LOAD(boxes->cx + i);
+            esVec4 cy = VEC4_LOAD(boxes->cy + i);
+            esVec4 cz = VEC4_LOAD(boxes->cz + i);
+            esVec4 ex = VEC4_LOAD(boxes->ex + i);
+            esVec4 ey = VEC4_LOAD(boxes->ey + i);
+            esVec4 ez = VEC4_LOAD(boxes->ez + i);
+            int    mask = 0xF;
+
+            for (p = 0; p < 6 && mask; p++)
+            {
+                const ESPlane *plane = &frustum->planes[p];
+                // Signed distance of the center plus the box's projected
+                // radius onto the plane normal
+                esVec4 dist = VEC4_ADD(VEC4_MUL(VEC4_SPLAT(plane->a), cx),
+                              VEC4_ADD(VEC4_MUL(VEC4_SPLAT(plane->b), cy),
+                              VEC4_ADD(VEC4_MUL(VEC4_SPLAT(plane->c), cz), VEC4_SPLAT(plane->d))));
+                esVec4 radius = VEC4_ADD(VEC4_MUL(VEC4_SPLAT(absA[p]), ex),
+                                VEC4_ADD(VEC4_MUL(VEC4_SPLAT(absB[p]), ey),
+                                         VEC4_MUL(VEC4_SPLAT(absC[p]), ez)));
+                mask &= VEC4_MOVEMASK(VEC4_CMPGE(VEC4_ADD(dist, radius), zero));
+            }
+
+            visible[numVisible] = i + 0; numVisible += (mask >> 0) & 1;
+            visible[numVisible] = i + 1; numVisible += (mask >> 1) & 1;
+            visible[numVisible] = i + 2; numVisible += (mask >> 2) & 1;
+            visible[numVisible] = i + 3; numVisible += (mask >> 3) & 1;
+        }
+    }
+#endif
+
+    for ( ; i < count; i++)
+    {
+        int inside = 1;
+
+        for (p = 0; p < 6 && inside; p++)
+        {
+            const ESPlane *plane = &frustum->planes[p];
+            GLfloat dist = plane->a * boxes->cx[i] + plane->b * boxes->cy[i] +
+                           plane->c * boxes->cz[i] + plane->d;
+            GLfloat radius = absA[p] * boxes->ex[i] + absB[p] * boxes->ey[i] + absC[p] * boxes->ez[i];
+            inside = dist + radius >= 0.0f;
+        }
+
+        visible[numVisible] = i;
+        numVisible += inside;
+    }
+
+    return numVisible;
+}
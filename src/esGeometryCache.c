@@ -0,0 +1,443 @@
+// esGeometryCache.c
+//
+//    Shares GPU buffers for generated shapes.  Geometry is keyed by shape,
+//    tessellation, scale and vertex format; repeated requests return the
+//    same reference counted buffers instead of regenerating them.  An
+//    optional persistent tier stores the packed vertex and index data as
+//    files, e.g. in the IDBFS mount at /working1, so a warm start skips
+//    generation, optimization and packing entirely.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#endif
+
+#define CACHE_FILE_MAGIC    0x43475345  // "ESGC"
+// 2: unorm16 texcoords are remapped with ESVertexLayout::texCoordScale/texCoordBias
+#define CACHE_FILE_VERSION  2
+
+typedef struct
+{
+   GLuint         magic;
+   GLuint         version;
+   GLint          shape;
+   GLint          slices;
+   GLfloat        scale;
+   GLuint         format;
+   GLint          numVertices;
+   GLint          numIndices;
+   GLenum         indexType;
+   GLint          numSubMeshes;
+   GLint          vertexBytes;
+   GLint          indexBytes;
+   ESVertexLayout layout;
+} CacheFileHeader;
+
+static ESGeometry geometryCache[ES_GEOMETRY_CACHE_SIZE];
+static char persistentPath[256];
+// Set when a file was written since the last esGeometryCacheFlush
+static GLboolean persistentDirty = GL_FALSE;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static void cacheFileName ( char *name, size_t size, int shape, int slices, float scale, GLuint format )
+{
+   union { GLfloat f; GLuint u; } bits;
+
+   bits.f = scale;
+   snprintf ( name, size, "%s/geometry_%d_%d_%08x_%x.bin", persistentPath, shape, slices, bits.u, format );
+}
+
+//
+// Upload packed data into a cache entry's buffers
+//
+static void uploadGeometry ( ESGeometry *geometry, const void *vertices, int vertexBytes,
+                             const void *indices, int indexBytes )
+{
+   glGenBuffers ( 1, &geometry->vertexBuffer );
+   esStateBindBuffer ( GL_ARRAY_BUFFER, geometry->vertexBuffer );
+   glBufferData ( GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW );
+
+   glGenBuffers ( 1, &geometry->indexBuffer );
+   esStateBindBuffer ( GL_ELEMENT_ARRAY_BUFFER, geometry->indexBuffer );
+   glBufferData ( GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW );
+}
+
+//
+// Check a header read from disk against the geometry it should hold and
+// the file's length, before any of its sizes are trusted
+//
+static GLboolean validHeader ( const CacheFileHeader *header, const ESGeometry *geometry, long fileBytes )
+{
+   ESVertexLayout layout;
+   long indexSize;
+
+   if ( header->magic != CACHE_FILE_MAGIC || header->version != CACHE_FILE_VERSION ||
+        header->shape != geometry->shape || header->slices != geometry->slices ||
+        header->scale != geometry->scale || header->format != geometry->format )
+      return GL_FALSE;
+
+   // The layout must be the one this context would pack, e.g. with the same half float support
+   esVertexLayoutInit ( geometry->format, &layout );
+   if ( header->layout.format != layout.format || header->layout.stride != layout.stride )
+      return GL_FALSE;
+
+   if ( header->indexType == GL_UNSIGNED_SHORT )
+      indexSize = sizeof(GLushort);
+   else if ( header->indexType == GL_UNSIGNED_INT )
+      indexSize = sizeof(GLuint);
+   else
+      return GL_FALSE;
+
+   if ( header->numVertices <= 0 || header->numIndices <= 0 ||
+        header->numSubMeshes <= 0 || header->numSubMeshes > header->numIndices / 3 )
+      return GL_FALSE;
+
+   if ( header->vertexBytes != (long long)header->numVertices * layout.stride ||
+        header->indexBytes != (long long)header->numIndices * indexSize )
+      return GL_FALSE;
+
+   return fileBytes == (long long)sizeof(CacheFileHeader) + (long long)header->numSubMeshes * (long long)sizeof(ESSubMesh) +
+                       header->vertexBytes + header->indexBytes;
+}
+
+static GLboolean validSubMeshes ( const ESSubMesh *subMeshes, int numSubMeshes, int numVertices, int numIndices )
+{
+   int i;
+
+   for ( i = 0; i < numSubMeshes; i++ )
+   {
+      const ESSubMesh *s = &subMeshes[i];
+
+      if ( s->firstVertex < 0 || s->numVertices < 0 || s->firstVertex > numVertices - s->numVertices ||
+           s->firstIndex < 0 || s->numIndices < 0 || s->firstIndex > numIndices - s->numIndices )
+         return GL_FALSE;
+   }
+   return GL_TRUE;
+}
+
+static GLboolean loadGeometry ( ESGeometry *geometry )
+{
+   CacheFileHeader header;
+   char name[320];
+   char *data = NULL;
+   FILE *file;
+   long fileBytes;
+   GLboolean ok = GL_FALSE;
+
+   if ( persistentPath[0] == '\0' )
+      return GL_FALSE;
+
+   cacheFileName ( name, sizeof(name), geometry->shape, geometry->slices, geometry->scale, geometry->format );
+   file = fopen ( name, "rb" );
+   if ( file == NULL )
+      return GL_FALSE;
+
+   // Sizes from disk are only trusted once they agree with the key and the file length
+   fseek ( file, 0, SEEK_END );
+   fileBytes = ftell ( file );
+   fseek ( file, 0, SEEK_SET );
+
+   if ( fread ( &header, sizeof(header), 1, file ) == 1 && validHeader ( &header, geometry, fileBytes ) )
+   {
+      int subMeshBytes = header.numSubMeshes * sizeof(ESSubMesh);
+
+      data = (char *)malloc ( subMeshBytes + header.vertexBytes + header.indexBytes );
+      geometry->subMeshes = (ESSubMesh *)malloc ( subMeshBytes );
+
+      if ( data && geometry->subMeshes &&
+           fread ( data, subMeshBytes + header.vertexBytes + header.indexBytes, 1, file ) == 1 &&
+           validSubMeshes ( (const ESSubMesh *)data, header.numSubMeshes, header.numVertices, header.numIndices ) )
+      {
+         memcpy ( geometry->subMeshes, data, subMeshBytes );
+         geometry->numSubMeshes = header.numSubMeshes;
+         geometry->numVertices = header.numVertices;
+         geometry->numIndices = header.numIndices;
+         geometry->indexType = header.indexType;
+         geometry->layout = header.layout;
+         uploadGeometry ( geometry, data + subMeshBytes, header.vertexBytes,
+                          data + subMeshBytes + header.vertexBytes, header.indexBytes );
+         ok = GL_TRUE;
+      }
+      else
+      {
+         free ( geometry->subMeshes );
+         geometry->subMeshes = NULL;
+      }
+   }
+
+   free ( data );
+   fclose ( file );
+
+   // Drop truncated, stale or corrupt files; the geometry is generated and saved again
+   if ( !ok )
+      remove ( name );
+   return ok;
+}
+
+static void saveGeometry ( const ESGeometry *geometry, const void *vertices, int vertexBytes,
+                           const void *indices, int indexBytes )
+{
+   CacheFileHeader header;
+   char name[320];
+   FILE *file;
+
+   if ( persistentPath[0] == '\0' )
+      return;
+
+   memset ( &header, 0, sizeof(header) );
+   header.magic = CACHE_FILE_MAGIC;
+   header.version = CACHE_FILE_VERSION;
+   header.shape = geometry->shape;
+   header.slices = geometry->slices;
+   header.scale = geometry->scale;
+   header.format = geometry->format;
+   header.numVertices = geometry->numVertices;
+   header.numIndices = geometry->numIndices;
+   header.indexType = geometry->indexType;
+   header.numSubMeshes = geometry->numSubMeshes;
+   header.vertexBytes = vertexBytes;
+   header.indexBytes = indexBytes;
+   header.layout = geometry->layout;
+
+   cacheFileName ( name, sizeof(name), geometry->shape, geometry->slices, geometry->scale, geometry->format );
+   file = fopen ( name, "wb" );
+   if ( file == NULL )
+      return;
+
+   fwrite ( &header, sizeof(header), 1, file );
+   fwrite ( geometry->subMeshes, sizeof(ESSubMesh), geometry->numSubMeshes, file );
+   fwrite ( vertices, vertexBytes, 1, file );
+   fwrite ( indices, indexBytes, 1, file );
+   fclose ( file );
+
+   // Pushed to IndexedDB by the next esGeometryCacheFlush, together with any other new files
+   persistentDirty = GL_TRUE;
+}
+
+//
+// Build the interleaved float mesh for a shape, in the same form
+// esGenSphereMesh returns
+//
+static GLboolean generateMesh ( int shape, int slices, float scale, ESMesh *mesh )
+{
+   if ( shape == ES_SHAPE_SPHERE )
+      return esGenSphereMesh ( slices, scale, ES_MESH_OPTIMIZE, mesh ) > 0;
+
+   if ( shape == ES_SHAPE_CUBE )
+   {
+      GLfloat *vertices, *normals, *texCoords;
+      GLushort *indices;
+      int numIndices = esGenCube ( scale, &vertices, &normals, &texCoords, &indices );
+      int i;
+
+      memset ( mesh, 0, sizeof(ESMesh) );
+      mesh->vertices = (GLfloat *)malloc ( 24 * ES_INTERLEAVED_VERTEX_SIZE );
+      mesh->subMeshes = (ESSubMesh *)malloc ( sizeof(ESSubMesh) );
+      if ( mesh->vertices && mesh->subMeshes )
+      {
+         for ( i = 0; i < 24; i++ )
+         {
+            memcpy ( mesh->vertices + i * 8, vertices + i * 3, 3 * sizeof(GLfloat) );
+            memcpy ( mesh->vertices + i * 8 + 3, normals + i * 3, 3 * sizeof(GLfloat) );
+            memcpy ( mesh->vertices + i * 8 + 6, texCoords + i * 2, 2 * sizeof(GLfloat) );
+         }
+         mesh->indices = indices;
+         mesh->indexType = GL_UNSIGNED_SHORT;
+         mesh->numVertices = 24;
+         mesh->numIndices = numIndices;
+         mesh->numSubMeshes = 1;
+         mesh->subMeshes[0].firstVertex = 0;
+         mesh->subMeshes[0].numVertices = 24;
+         mesh->subMeshes[0].firstIndex = 0;
+         mesh->subMeshes[0].numIndices = numIndices;
+         indices = NULL;
+      }
+
+      free ( vertices );
+      free ( normals );
+      free ( texCoords );
+      free ( indices );
+      if ( mesh->indices == NULL )
+      {
+         esFreeMesh ( mesh );
+         return GL_FALSE;
+      }
+      return GL_TRUE;
+   }
+
+   return GL_FALSE;
+}
+
+static GLboolean createGeometry ( ESGeometry *geometry )
+{
+   ESMesh mesh;
+   void *packed;
+   int vertexBytes, indexBytes;
+   int i;
+
+   if ( !generateMesh ( geometry->shape, geometry->slices, geometry->scale, &mesh ) )
+      return GL_FALSE;
+
+   esVertexLayoutInit ( geometry->format, &geometry->layout );
+   packed = malloc ( mesh.numVertices * geometry->layout.stride );
+   geometry->subMeshes = (ESSubMesh *)malloc ( mesh.numSubMeshes * sizeof(ESSubMesh) );
+   if ( packed == NULL || geometry->subMeshes == NULL )
+   {
+      free ( packed );
+      free ( geometry->subMeshes );
+      geometry->subMeshes = NULL;
+      esFreeMesh ( &mesh );
+      return GL_FALSE;
+   }
+
+   vertexBytes = esPackVertices ( geometry->format, mesh.vertices, mesh.numVertices, packed, &geometry->layout );
+   indexBytes = mesh.numIndices * ( mesh.indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort) );
+
+   for ( i = 0; i < mesh.numSubMeshes; i++ )
+      geometry->subMeshes[i] = mesh.subMeshes[i];
+   geometry->numSubMeshes = mesh.numSubMeshes;
+   geometry->numVertices = mesh.numVertices;
+   geometry->numIndices = mesh.numIndices;
+   geometry->indexType = mesh.indexType;
+
+   uploadGeometry ( geometry, packed, vertexBytes, mesh.indices, indexBytes );
+   saveGeometry ( geometry, packed, vertexBytes, mesh.indices, indexBytes );
+
+   free ( packed );
+   esFreeMesh ( &mesh );
+   return GL_TRUE;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+void ESUTIL_API esGeometryCachePersist ( const char *directory )
+{
+   if ( directory == NULL )
+      persistentPath[0] = '\0';
+   else
+      snprintf ( persistentPath, sizeof(persistentPath), "%s", directory );
+}
+
+void ESUTIL_API esGeometryCacheFlush ( void )
+{
+   if ( !persistentDirty )
+      return;
+   persistentDirty = GL_FALSE;
+
+#ifdef __EMSCRIPTEN__
+   // The IDBFS mount lives in the main thread's FS, so sync there even when
+   // called from the render thread.  A sync already in flight runs once more
+   // when it finishes instead of overlapping with a new one.
+   MAIN_THREAD_ASYNC_EM_ASM(
+      if ( Module.esGeometrySyncing )
+      {
+         Module.esGeometrySyncAgain = true;
+         return;
+      }
+      Module.esGeometrySyncing = true;
+      var sync = function () {
+         Module.esGeometrySyncAgain = false;
+         FS.syncfs(false, function (err) {
+            if ( Module.esGeometrySyncAgain )
+               sync();
+            else
+               Module.esGeometrySyncing = false;
+         });
+      };
+      sync();
+   );
+#endif
+}
+
+const ESGeometry * ESUTIL_API esGeometryAcquire ( int shape, int slices, float scale, GLuint format )
+{
+   ESGeometry *geometry = NULL;
+   int i;
+
+   if ( shape == ES_SHAPE_CUBE )
+      slices = 0;
+
+   for ( i = 0; i < ES_GEOMETRY_CACHE_SIZE; i++ )
+   {
+      ESGeometry *entry = &geometryCache[i];
+
+      if ( entry->refCount > 0 && entry->shape == shape && entry->slices == slices &&
+           entry->scale == scale && entry->format == format )
+      {
+         entry->refCount++;
+         return entry;
+      }
+      if ( entry->refCount == 0 && geometry == NULL )
+         geometry = entry;
+   }
+
+   if ( geometry == NULL )
+   {
+      esLogMessage ( "Geometry cache full (%d entries)\n", ES_GEOMETRY_CACHE_SIZE );
+      return NULL;
+   }
+
+   memset ( geometry, 0, sizeof(ESGeometry) );
+   geometry->shape = shape;
+   geometry->slices = slices;
+   geometry->scale = scale;
+   geometry->format = format;
+
+   if ( !loadGeometry ( geometry ) && !createGeometry ( geometry ) )
+      return NULL;
+
+   geometry->refCount = 1;
+   return geometry;
+}
+
+void ESUTIL_API esGeometryRelease ( const ESGeometry *geometry )
+{
+   ESGeometry *entry = (ESGeometry *)geometry;
+
+   if ( entry == NULL || entry->refCount <= 0 )
+      return;
+
+   if ( --entry->refCount == 0 )
+   {
+      esStateDeleteBuffers ( 1, &entry->vertexBuffer );
+      esStateDeleteBuffers ( 1, &entry->indexBuffer );
+      free ( entry->subMeshes );
+      memset ( entry, 0, sizeof(ESGeometry) );
+   }
+}
+
+void ESUTIL_API esDrawGeometry ( const ESGeometry *geometry, GLint positionLoc, GLint normalLoc, GLint texCoordLoc )
+{
+   int indexSize = geometry->indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+   int i;
+
+   esStateBindBuffer ( GL_ARRAY_BUFFER, geometry->vertexBuffer );
+   esStateBindBuffer ( GL_ELEMENT_ARRAY_BUFFER, geometry->indexBuffer );
+
+   for ( i = 0; i < geometry->numSubMeshes; i++ )
+   {
+      const ESSubMesh *sub = &geometry->subMeshes[i];
+
+      esVertexLayoutBind ( &geometry->layout, positionLoc, normalLoc, texCoordLoc,
+                           sub->firstVertex * geometry->layout.stride );
+      glDrawElements ( GL_TRIANGLES, sub->numIndices, geometry->indexType,
+                       (char *)0 + sub->firstIndex * indexSize );
+   }
+}
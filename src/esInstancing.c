@@ -0,0 +1,347 @@
+// esInstancing.c
+//
+//    Draws many copies of one mesh with few draw calls.  With
+//    ANGLE_instanced_arrays the per-instance data is streamed as vertex
+//    attributes with a divisor of 1 and the whole set is one
+//    glDrawElementsInstancedANGLE.  Without it the mesh is replicated
+//    batchSize times into a static buffer, every copy tagged with its index
+//    in the batch, and per-instance data goes into a uniform vec4 array
+//    ("pseudo-instancing"), so each draw call covers batchSize instances.
+//
+//    Shaders prepend shaderHeader from the ESInstancedMesh and transform
+//    with esInstancePosition() and esInstanceNormal(), which hide the
+//    difference between the two paths.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Vertex uniforms kept free for the rest of the shader, e.g. the view-projection matrix
+#define RESERVED_UNIFORM_VECTORS  16
+
+static PFNGLDRAWELEMENTSINSTANCEDANGLEPROC drawElementsInstanced = NULL;
+static PFNGLVERTEXATTRIBDIVISORANGLEPROC vertexAttribDivisor = NULL;
+
+//
+// Rotation by the conjugate of q, which is how the matrix from
+// esComposeTRS rotates vectors once uploaded with glUniformMatrix4fv
+//
+static const char instanceTRS[] =
+   "vec3 esInstanceRotate(vec4 q, vec3 v)\n"
+   "{\n"
+   "   return v + 2.0 * cross(q.xyz, cross(q.xyz, v) - q.w * v);\n"
+   "}\n"
+   "vec3 esInstancePosition(vec3 p)\n"
+   "{\n"
+   "   return esInstanceRotate(esInstance1, p * esInstance0.w) + esInstance0.xyz;\n"
+   "}\n"
+   "vec3 esInstanceNormal(vec3 n)\n"
+   "{\n"
+   "   return esInstanceRotate(esInstance1, n);\n"
+   "}\n";
+
+static const char instanceMatrix[] =
+   "vec3 esInstancePosition(vec3 p)\n"
+   "{\n"
+   "   return (mat4(esInstance0, esInstance1, esInstance2, esInstance3) * vec4(p, 1.0)).xyz;\n"
+   "}\n"
+   "vec3 esInstanceNormal(vec3 n)\n"
+   "{\n"
+   "   return mat3(esInstance0.xyz, esInstance1.xyz, esInstance2.xyz) * n;\n"
+   "}\n";
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static GLboolean loadInstancedArrays ( void )
+{
+   if ( drawElementsInstanced != NULL && vertexAttribDivisor != NULL )
+      return GL_TRUE;
+
+   if ( !esHasExtension ( "GL_ANGLE_instanced_arrays" ) )
+      return GL_FALSE;
+
+   drawElementsInstanced = (PFNGLDRAWELEMENTSINSTANCEDANGLEPROC)eglGetProcAddress ( "glDrawElementsInstancedANGLE" );
+   vertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORANGLEPROC)eglGetProcAddress ( "glVertexAttribDivisorANGLE" );
+   return drawElementsInstanced != NULL && vertexAttribDivisor != NULL;
+}
+
+static void buildShaderHeader ( ESInstancedMesh *mesh )
+{
+   int vec4s = mesh->vec4sPerInstance;
+   char *out = mesh->shaderHeader;
+   size_t size = sizeof(mesh->shaderHeader);
+   int len, i;
+
+   if ( mesh->instancedArrays )
+   {
+      len = 0;
+      for ( i = 0; i < vec4s; i++ )
+         len += snprintf ( out + len, size - len, "attribute vec4 esInstance%d;\n", i );
+   }
+   else
+   {
+      len = snprintf ( out, size,
+                       "attribute float esInstanceId;\n"
+                       "uniform vec4 esInstanceData[%d];\n",
+                       mesh->batchSize * vec4s );
+      for ( i = 0; i < vec4s; i++ )
+         len += snprintf ( out + len, size - len,
+                           "#define esInstance%d esInstanceData[int(esInstanceId) * %d + %d]\n", i, vec4s, i );
+   }
+
+   snprintf ( out + len, size - len, "%s", mesh->format == ES_INSTANCE_TRS ? instanceTRS : instanceMatrix );
+}
+
+//
+// Interleave the esGen* arrays, repeated copies times with the copy index
+// appended to every vertex when tagged
+//
+static GLfloat *interleave ( int numVertices, const GLfloat *vertices, const GLfloat *normals,
+                             const GLfloat *texCoords, int copies, GLboolean tagged )
+{
+   int stride = tagged ? 9 : 8;
+   GLfloat *data = (GLfloat *)calloc ( (size_t)numVertices * copies * stride, sizeof(GLfloat) );
+   GLfloat *v = data;
+   int c, i;
+
+   if ( data == NULL )
+      return NULL;
+
+   for ( c = 0; c < copies; c++ )
+   {
+      for ( i = 0; i < numVertices; i++, v += stride )
+      {
+         memcpy ( v, vertices + i * 3, 3 * sizeof(GLfloat) );
+         if ( normals )
+            memcpy ( v + 3, normals + i * 3, 3 * sizeof(GLfloat) );
+         if ( texCoords )
+            memcpy ( v + 6, texCoords + i * 2, 2 * sizeof(GLfloat) );
+         if ( tagged )
+            v[8] = (GLfloat)c;
+      }
+   }
+   return data;
+}
+
+static void bindMeshAttribs ( const ESInstancedMesh *mesh, GLint positionLoc, GLint normalLoc, GLint texCoordLoc )
+{
+   GLsizei stride = mesh->instancedArrays ? 8 * sizeof(GLfloat) : 9 * sizeof(GLfloat);
+
+   esStateBindBuffer ( GL_ARRAY_BUFFER, mesh->vertexBuffer );
+   esStateBindBuffer ( GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer );
+
+   if ( positionLoc >= 0 )
+      esStateVertexAttribPointer ( positionLoc, 3, GL_FLOAT, GL_FALSE, stride, (char *)0 );
+   if ( normalLoc >= 0 )
+      esStateVertexAttribPointer ( normalLoc, 3, GL_FLOAT, GL_FALSE, stride, (char *)0 + 3 * sizeof(GLfloat) );
+   if ( texCoordLoc >= 0 )
+      esStateVertexAttribPointer ( texCoordLoc, 2, GL_FLOAT, GL_FALSE, stride, (char *)0 + 6 * sizeof(GLfloat) );
+   if ( !mesh->instancedArrays && mesh->instanceIdLoc >= 0 )
+   {
+      esStateVertexAttribPointer ( mesh->instanceIdLoc, 1, GL_FLOAT, GL_FALSE, stride, (char *)0 + 8 * sizeof(GLfloat) );
+      esStateEnableVertexAttribArray ( mesh->instanceIdLoc );
+   }
+}
+
+static void drawInstancedArrays ( const ESInstancedMesh *mesh, const GLfloat *instanceData, int count )
+{
+   GLsizei instanceSize = mesh->vec4sPerInstance * 4 * sizeof(GLfloat);
+   int chunk = count;
+   int i;
+
+   for ( i = 0; i < mesh->vec4sPerInstance; i++ )
+   {
+      if ( mesh->instanceLoc[i] < 0 )
+         continue;
+      esStateEnableVertexAttribArray ( mesh->instanceLoc[i] );
+      vertexAttribDivisor ( mesh->instanceLoc[i], 1 );
+   }
+
+   // Stream the instance data, in smaller chunks if it does not fit a stream buffer
+   while ( count > 0 )
+   {
+      ESStreamAlloc alloc;
+
+      if ( chunk > count )
+         chunk = count;
+      alloc = esStreamAlloc ( (GLsizeiptr)chunk * instanceSize );
+      if ( alloc.ptr == NULL )
+      {
+         if ( chunk == 1 )
+            break;
+         chunk /= 2;
+         continue;
+      }
+
+      memcpy ( alloc.ptr, instanceData, (size_t)chunk * instanceSize );
+      esStreamFlush ( );
+
+      esStateBindBuffer ( GL_ARRAY_BUFFER, alloc.buffer );
+      for ( i = 0; i < mesh->vec4sPerInstance; i++ )
+      {
+         if ( mesh->instanceLoc[i] >= 0 )
+            esStateVertexAttribPointer ( mesh->instanceLoc[i], 4, GL_FLOAT, GL_FALSE, instanceSize,
+                                    (char *)0 + alloc.offset + i * 4 * sizeof(GLfloat) );
+      }
+
+      drawElementsInstanced ( GL_TRIANGLES, mesh->numIndices, GL_UNSIGNED_SHORT, (char *)0, chunk );
+
+      instanceData += chunk * mesh->vec4sPerInstance * 4;
+      count -= chunk;
+   }
+
+   // Leave the divisors at 0 so ordinary draws are unaffected
+   for ( i = 0; i < mesh->vec4sPerInstance; i++ )
+   {
+      if ( mesh->instanceLoc[i] < 0 )
+         continue;
+      vertexAttribDivisor ( mesh->instanceLoc[i], 0 );
+      esStateDisableVertexAttribArray ( mesh->instanceLoc[i] );
+   }
+}
+
+static void drawPseudoInstanced ( const ESInstancedMesh *mesh, const GLfloat *instanceData, int count )
+{
+   while ( count > 0 )
+   {
+      int batch = count < mesh->batchSize ? count : mesh->batchSize;
+
+      glUniform4fv ( mesh->instanceDataLoc, batch * mesh->vec4sPerInstance, instanceData );
+      glDrawElements ( GL_TRIANGLES, batch * mesh->numIndices, GL_UNSIGNED_SHORT, (char *)0 );
+
+      instanceData += batch * mesh->vec4sPerInstance * 4;
+      count -= batch;
+   }
+
+   // The instance array was set behind the back of any esSetUniform* cache
+   esReflectionInvalidate ( NULL );
+
+   if ( mesh->instanceIdLoc >= 0 )
+      esStateDisableVertexAttribArray ( mesh->instanceIdLoc );
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+GLboolean ESUTIL_API esInstancedMeshInit ( ESInstancedMesh *mesh, const GLfloat *vertices, const GLfloat *normals,
+                                           const GLfloat *texCoords, const GLushort *indices, int numIndices,
+                                           GLuint format, GLboolean allowInstancedArrays )
+{
+   GLfloat *data;
+   GLushort *batchIndices = NULL;
+   int numVertices = 0;
+   int copies = 1;
+   int i, c;
+
+   memset ( mesh, 0, sizeof(ESInstancedMesh) );
+   mesh->format = format;
+   mesh->vec4sPerInstance = format == ES_INSTANCE_TRS ? 2 : 4;
+   mesh->numIndices = numIndices;
+   mesh->instanceIdLoc = -1;
+   mesh->instanceDataLoc = -1;
+   for ( i = 0; i < 4; i++ )
+      mesh->instanceLoc[i] = -1;
+
+   for ( i = 0; i < numIndices; i++ )
+      numVertices = indices[i] + 1 > numVertices ? indices[i] + 1 : numVertices;
+   mesh->numVertices = numVertices;
+   if ( numVertices == 0 )
+      return GL_FALSE;
+
+   mesh->instancedArrays = allowInstancedArrays && loadInstancedArrays ( );
+   if ( !mesh->instancedArrays )
+   {
+      GLint maxVectors = 128;
+
+      // As many instances as fit the uniform budget and 16-bit indices
+      glGetIntegerv ( GL_MAX_VERTEX_UNIFORM_VECTORS, &maxVectors );
+      mesh->batchSize = ( maxVectors - RESERVED_UNIFORM_VECTORS ) / mesh->vec4sPerInstance;
+      if ( mesh->batchSize > 65536 / numVertices )
+         mesh->batchSize = 65536 / numVertices;
+      if ( mesh->batchSize < 1 )
+         mesh->batchSize = 1;
+      copies = mesh->batchSize;
+   }
+
+   data = interleave ( numVertices, vertices, normals, texCoords, copies, !mesh->instancedArrays );
+   if ( copies > 1 )
+      batchIndices = (GLushort *)malloc ( sizeof(GLushort) * numIndices * copies );
+
+   if ( data == NULL || ( copies > 1 && batchIndices == NULL ) )
+   {
+      free ( data );
+      free ( batchIndices );
+      return GL_FALSE;
+   }
+
+   for ( c = 1; c < copies; c++ )
+      for ( i = 0; i < numIndices; i++ )
+         batchIndices[c * numIndices + i] = (GLushort)( indices[i] + c * numVertices );
+   if ( batchIndices )
+      memcpy ( batchIndices, indices, sizeof(GLushort) * numIndices );
+
+   glGenBuffers ( 1, &mesh->vertexBuffer );
+   esStateBindBuffer ( GL_ARRAY_BUFFER, mesh->vertexBuffer );
+   glBufferData ( GL_ARRAY_BUFFER, (GLsizeiptr)numVertices * copies * ( mesh->instancedArrays ? 8 : 9 ) * sizeof(GLfloat),
+                  data, GL_STATIC_DRAW );
+
+   glGenBuffers ( 1, &mesh->indexBuffer );
+   esStateBindBuffer ( GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer );
+   glBufferData ( GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * numIndices * copies,
+                  batchIndices ? batchIndices : indices, GL_STATIC_DRAW );
+
+   free ( data );
+   free ( batchIndices );
+
+   buildShaderHeader ( mesh );
+   return GL_TRUE;
+}
+
+void ESUTIL_API esInstancedMeshFree ( ESInstancedMesh *mesh )
+{
+   esStateDeleteBuffers ( 1, &mesh->vertexBuffer );
+   esStateDeleteBuffers ( 1, &mesh->indexBuffer );
+   memset ( mesh, 0, sizeof(ESInstancedMesh) );
+}
+
+void ESUTIL_API esInstancedMeshSetProgram ( ESInstancedMesh *mesh, GLuint programObject )
+{
+   char name[16];
+   int i;
+
+   for ( i = 0; i < mesh->vec4sPerInstance; i++ )
+   {
+      snprintf ( name, sizeof(name), "esInstance%d", i );
+      mesh->instanceLoc[i] = mesh->instancedArrays ? glGetAttribLocation ( programObject, name ) : -1;
+   }
+   mesh->instanceIdLoc = mesh->instancedArrays ? -1 : glGetAttribLocation ( programObject, "esInstanceId" );
+   mesh->instanceDataLoc = mesh->instancedArrays ? -1 : glGetUniformLocation ( programObject, "esInstanceData" );
+}
+
+void ESUTIL_API esDrawInstanced ( const ESInstancedMesh *mesh, const GLfloat *instanceData, int count,
+                                  GLint positionLoc, GLint normalLoc, GLint texCoordLoc )
+{
+   if ( count <= 0 )
+      return;
+
+   bindMeshAttribs ( mesh, positionLoc, normalLoc, texCoordLoc );
+
+   if ( mesh->instancedArrays )
+      drawInstancedArrays ( mesh, instanceData, count );
+   else
+      drawPseudoInstanced ( mesh, instanceData, count );
+}
@@ -0,0 +1,288 @@
+// esMeshOpt.c
+//
+//    Index and vertex reordering for the post-transform vertex cache and
+//    for vertex fetch locality.  Triangle order is optimized with Tipsify
+//    (Sander, Nehab, Barczak - "Fast Triangle Reordering for Vertex
+//    Locality and Reduced Overdraw", 2007), and vertices are then renumbered
+//    in order of first use.  Cache efficiency is reported as ACMR, the
+//    average number of cache misses (vertex shader runs) per triangle.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static GLuint getIndex ( const void *indices, GLenum indexType, int i )
+{
+   if ( indexType == GL_UNSIGNED_INT )
+      return ((const GLuint *)indices)[i];
+   return ((const GLushort *)indices)[i];
+}
+
+static void setIndex ( void *indices, GLenum indexType, int i, GLuint value )
+{
+   if ( indexType == GL_UNSIGNED_INT )
+      ((GLuint *)indices)[i] = value;
+   else
+      ((GLushort *)indices)[i] = (GLushort)value;
+}
+
+//
+// Pop the dead-end stack for a vertex that still has live triangles, and
+// failing that scan forward through the vertices from *cursor.
+//
+static int skipDeadEnd ( const int *liveTriangles, int *deadEnd, int *deadEndCount,
+                         int *cursor, int numVertices )
+{
+   while ( *deadEndCount > 0 )
+   {
+      int v = deadEnd[--(*deadEndCount)];
+      if ( liveTriangles[v] > 0 )
+         return v;
+   }
+
+   while ( *cursor < numVertices )
+   {
+      int v = (*cursor)++;
+      if ( liveTriangles[v] > 0 )
+         return v;
+   }
+
+   return -1;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+float ESUTIL_API esMeshACMR ( const void *indices, GLenum indexType, int numIndices, int numVertices, int cacheSize )
+{
+   int *cacheTime;
+   int time = cacheSize + 1;
+   int misses = 0;
+   int i;
+
+   if ( numIndices < 3 )
+      return 0.0f;
+
+   cacheTime = (int *)calloc ( numVertices, sizeof(int) );
+   if ( cacheTime == NULL )
+      return 0.0f;
+
+   // FIFO cache: a vertex is resident if fewer than cacheSize misses have
+   // happened since it was last loaded
+   for ( i = 0; i < numIndices; i++ )
+   {
+      GLuint v = getIndex ( indices, indexType, i );
+
+      if ( time - cacheTime[v] > cacheSize )
+      {
+         cacheTime[v] = time++;
+         misses++;
+      }
+   }
+
+   free ( cacheTime );
+   return (float)misses / (float)( numIndices / 3 );
+}
+
+GLboolean ESUTIL_API esOptimizeVertexCache ( void *indices, GLenum indexType, int numIndices, int numVertices, int cacheSize )
+{
+   int numTriangles = numIndices / 3;
+   int *adjacencyOffset = (int *)calloc ( numVertices + 1, sizeof(int) );
+   int *adjacency = (int *)malloc ( sizeof(int) * numIndices );
+   int *liveTriangles = (int *)calloc ( numVertices, sizeof(int) );
+   int *cacheTime = (int *)calloc ( numVertices, sizeof(int) );
+   int *deadEnd = (int *)malloc ( sizeof(int) * numIndices );
+   int *candidates = (int *)malloc ( sizeof(int) * numIndices );
+   unsigned char *emitted = (unsigned char *)calloc ( numTriangles, 1 );
+   GLuint *output = (GLuint *)malloc ( sizeof(GLuint) * numIndices );
+   int deadEndCount = 0;
+   int cursor = 1;
+   int time = cacheSize + 1;
+   int outputCount = 0;
+   int fanning = 0;
+   int i, t;
+
+   if ( !adjacencyOffset || !adjacency || !liveTriangles || !cacheTime ||
+        !deadEnd || !candidates || !emitted || !output )
+   {
+      free ( adjacencyOffset ); free ( adjacency ); free ( liveTriangles ); free ( cacheTime );
+      free ( deadEnd ); free ( candidates ); free ( emitted ); free ( output );
+      return GL_FALSE;
+   }
+
+   // Vertex -> triangle adjacency as a compact offset table
+   for ( i = 0; i < numTriangles * 3; i++ )
+      liveTriangles[getIndex ( indices, indexType, i )]++;
+   for ( i = 0; i < numVertices; i++ )
+      adjacencyOffset[i + 1] = adjacencyOffset[i] + liveTriangles[i];
+   for ( i = 0; i < numTriangles * 3; i++ )
+   {
+      GLuint v = getIndex ( indices, indexType, i );
+      adjacency[adjacencyOffset[v]++] = i / 3;
+   }
+   for ( i = numVertices; i > 0; i-- )
+      adjacencyOffset[i] = adjacencyOffset[i - 1];
+   adjacencyOffset[0] = 0;
+
+   while ( fanning >= 0 )
+   {
+      int numCandidates = 0;
+      int best = -1;
+      int bestPriority = -1;
+
+      // Emit every remaining triangle around the fanning vertex
+      for ( t = adjacencyOffset[fanning]; t < adjacencyOffset[fanning + 1]; t++ )
+      {
+         int tri = adjacency[t];
+         int k;
+
+         if ( emitted[tri] )
+            continue;
+
+         for ( k = 0; k < 3; k++ )
+         {
+            GLuint v = getIndex ( indices, indexType, tri * 3 + k );
+
+            output[outputCount++] = v;
+            deadEnd[deadEndCount++] = v;
+            candidates[numCandidates++] = v;
+            liveTriangles[v]--;
+
+            if ( time - cacheTime[v] > cacheSize )
+               cacheTime[v] = time++;
+         }
+         emitted[tri] = 1;
+      }
+
+      // Next fanning vertex: the one-ring vertex that will still be in the
+      // cache after its remaining triangles are emitted, preferring the
+      // oldest such entry
+      for ( i = 0; i < numCandidates; i++ )
+      {
+         int v = candidates[i];
+
+         if ( liveTriangles[v] > 0 )
+         {
+            int priority = 0;
+
+            if ( time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize )
+               priority = time - cacheTime[v];
+
+            if ( priority > bestPriority )
+            {
+               bestPriority = priority;
+               best = v;
+            }
+         }
+      }
+
+      if ( best == -1 )
+         best = skipDeadEnd ( liveTriangles, deadEnd, &deadEndCount, &cursor, numVertices );
+
+      fanning = best;
+   }
+
+   for ( i = 0; i < outputCount; i++ )
+      setIndex ( indices, indexType, i, output[i] );
+
+   free ( adjacencyOffset ); free ( adjacency ); free ( liveTriangles ); free ( cacheTime );
+   free ( deadEnd ); free ( candidates ); free ( emitted ); free ( output );
+   return GL_TRUE;
+}
+
+void ESUTIL_API esOptimizeVertexFetch ( void *indices, GLenum indexType, int numIndices, int numVertices, GLuint *remap )
+{
+   GLuint next = 0;
+   int i;
+
+   for ( i = 0; i < numVertices; i++ )
+      remap[i] = (GLuint)-1;
+
+   for ( i = 0; i < numIndices; i++ )
+   {
+      GLuint v = getIndex ( indices, indexType, i );
+
+      if ( remap[v] == (GLuint)-1 )
+         remap[v] = next++;
+      setIndex ( indices, indexType, i, remap[v] );
+   }
+
+   // Unreferenced vertices go to the end
+   for ( i = 0; i < numVertices; i++ )
+   {
+      if ( remap[i] == (GLuint)-1 )
+         remap[i] = next++;
+   }
+}
+
+GLboolean ESUTIL_API esRemapVertices ( void *vertices, int numVertices, int stride, const GLuint *remap )
+{
+   char *copy = (char *)malloc ( numVertices * stride );
+   int i;
+
+   if ( copy == NULL )
+      return GL_FALSE;
+
+   memcpy ( copy, vertices, numVertices * stride );
+   for ( i = 0; i < numVertices; i++ )
+      memcpy ( (char *)vertices + remap[i] * stride, copy + i * stride, stride );
+
+   free ( copy );
+   return GL_TRUE;
+}
+
+GLboolean ESUTIL_API esOptimizeMesh ( ESMesh *mesh, int cacheSize, float *acmrBefore, float *acmrAfter )
+{
+   int indexSize = mesh->indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+   int misses[2] = { 0, 0 };
+   int i;
+
+   for ( i = 0; i < mesh->numSubMeshes; i++ )
+   {
+      ESSubMesh *sub = &mesh->subMeshes[i];
+      void *indices = (char *)mesh->indices + sub->firstIndex * indexSize;
+      GLfloat *vertices = mesh->vertices + sub->firstVertex * 8;
+      GLuint *remap = (GLuint *)malloc ( sizeof(GLuint) * sub->numVertices );
+
+      if ( remap == NULL )
+         return GL_FALSE;
+
+      misses[0] += (int)( esMeshACMR ( indices, mesh->indexType, sub->numIndices, sub->numVertices, cacheSize ) *
+                          ( sub->numIndices / 3 ) + 0.5f );
+
+      if ( !esOptimizeVertexCache ( indices, mesh->indexType, sub->numIndices, sub->numVertices, cacheSize ) )
+      {
+         free ( remap );
+         return GL_FALSE;
+      }
+      esOptimizeVertexFetch ( indices, mesh->indexType, sub->numIndices, sub->numVertices, remap );
+      if ( !esRemapVertices ( vertices, sub->numVertices, ES_INTERLEAVED_VERTEX_SIZE, remap ) )
+      {
+         free ( remap );
+         return GL_FALSE;
+      }
+
+      misses[1] += (int)( esMeshACMR ( indices, mesh->indexType, sub->numIndices, sub->numVertices, cacheSize ) *
+                          ( sub->numIndices / 3 ) + 0.5f );
+      free ( remap );
+   }
+
+   if ( acmrBefore != NULL )
+      *acmrBefore = mesh->numIndices ? (float)misses[0] / (float)( mesh->numIndices / 3 ) : 0.0f;
+   if ( acmrAfter != NULL )
+      *acmrAfter = mesh->numIndices ? (float)misses[1] / (float)( mesh->numIndices / 3 ) : 0.0f;
+   return GL_TRUE;
+}
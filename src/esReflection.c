@@ -0,0 +1,293 @@
+// esReflection.c
+//
+//    Program reflection.  The active uniforms and attributes of a linked
+//    program are enumerated once with glGetActiveUniform/glGetActiveAttrib,
+//    so draw code looks locations up in a hash table instead of calling
+//    glGetUniformLocation.  The last value set to every uniform is kept, and
+//    the esSetUniform* functions skip glUniform* calls that would not change
+//    anything.  Code that calls glUniform* directly reports it through
+//    esReflectionInvalidate.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Bumped by esReflectionInvalidate ( NULL ); a reflection that saw an older
+// value forgets all of its stored values on its next upload
+static GLuint invalidateEpoch;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+//
+// 32-bit FNV-1a of a variable name
+//
+static GLuint hashName ( const char *name )
+{
+   GLuint hash = 2166136261u;
+
+   while ( *name != '\0' )
+   {
+      hash ^= (unsigned char)*name++;
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+//
+// Number of 4-byte words in one element of a uniform type
+//
+static int typeWords ( GLenum type )
+{
+   switch ( type )
+   {
+      case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_BOOL_VEC2:
+         return 2;
+      case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_BOOL_VEC3:
+         return 3;
+      case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2:
+         return 4;
+      case GL_FLOAT_MAT3:
+         return 9;
+      case GL_FLOAT_MAT4:
+         return 16;
+      default:
+         return 1;
+   }
+}
+
+static GLboolean isFloatType ( GLenum type )
+{
+   switch ( type )
+   {
+      case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4:
+      case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+         return GL_TRUE;
+      default:
+         return GL_FALSE;
+   }
+}
+
+static ESShaderVariable *lookup ( const ESReflection *reflection, const char *name, int first, int last )
+{
+   GLuint slot;
+
+   if ( reflection->table == NULL )
+      return NULL;
+
+   for ( slot = hashName ( name ) & reflection->tableMask; reflection->table[slot] != 0;
+         slot = ( slot + 1 ) & reflection->tableMask )
+   {
+      int index = reflection->table[slot] - 1;
+
+      if ( index >= first && index < last && strcmp ( reflection->variables[index].name, name ) == 0 )
+         return &reflection->variables[index];
+   }
+   return NULL;
+}
+
+//
+// Upload count elements of a uniform unless they equal the stored value
+//
+static void setUniform ( ESReflection *reflection, const ESShaderVariable *uniform, GLsizei count, const void *value )
+{
+   GLuint *stored;
+   size_t bytes;
+   int index;
+
+   if ( uniform == NULL || count <= 0 )
+      return;
+   index = (int)( uniform - reflection->variables );
+   if ( count > uniform->size )
+      count = uniform->size;
+
+   if ( reflection->epoch != invalidateEpoch )
+      esReflectionInvalidate ( reflection );
+
+   stored = reflection->values + uniform->valueOffset;
+   bytes = sizeof(GLuint) * typeWords ( uniform->type ) * count;
+   if ( reflection->known[index] && memcmp ( stored, value, bytes ) == 0 )
+      return;
+   memcpy ( stored, value, bytes );
+   // Elements past count keep their old GL value only if they were known
+   if ( count == uniform->size )
+      reflection->known[index] = 1;
+
+   esStateUseProgram ( reflection->program );
+   switch ( uniform->type )
+   {
+      case GL_FLOAT:      glUniform1fv ( uniform->location, count, (const GLfloat *)value ); break;
+      case GL_FLOAT_VEC2: glUniform2fv ( uniform->location, count, (const GLfloat *)value ); break;
+      case GL_FLOAT_VEC3: glUniform3fv ( uniform->location, count, (const GLfloat *)value ); break;
+      case GL_FLOAT_VEC4: glUniform4fv ( uniform->location, count, (const GLfloat *)value ); break;
+      case GL_FLOAT_MAT2: glUniformMatrix2fv ( uniform->location, count, GL_FALSE, (const GLfloat *)value ); break;
+      case GL_FLOAT_MAT3: glUniformMatrix3fv ( uniform->location, count, GL_FALSE, (const GLfloat *)value ); break;
+      case GL_FLOAT_MAT4: glUniformMatrix4fv ( uniform->location, count, GL_FALSE, (const GLfloat *)value ); break;
+      case GL_INT_VEC2: case GL_BOOL_VEC2: glUniform2iv ( uniform->location, count, (const GLint *)value ); break;
+      case GL_INT_VEC3: case GL_BOOL_VEC3: glUniform3iv ( uniform->location, count, (const GLint *)value ); break;
+      case GL_INT_VEC4: case GL_BOOL_VEC4: glUniform4iv ( uniform->location, count, (const GLint *)value ); break;
+      default:            glUniform1iv ( uniform->location, count, (const GLint *)value ); break;
+   }
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+GLboolean ESUTIL_API esReflectionInit ( ESReflection *reflection, GLuint program )
+{
+   GLint numUniforms = 0, numAttribs = 0;
+   GLint uniformNameLen = 0, attribNameLen = 0;
+   GLsizei maxNameLen;
+   GLuint tableSize = 1;
+   int numVariables, numWords = 0;
+   char *name;
+   int i;
+
+   memset ( reflection, 0, sizeof(ESReflection) );
+   reflection->program = program;
+
+   glGetProgramiv ( program, GL_ACTIVE_UNIFORMS, &numUniforms );
+   glGetProgramiv ( program, GL_ACTIVE_ATTRIBUTES, &numAttribs );
+   glGetProgramiv ( program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformNameLen );
+   glGetProgramiv ( program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &attribNameLen );
+   maxNameLen = ( uniformNameLen > attribNameLen ? uniformNameLen : attribNameLen ) + 1;
+   numVariables = numUniforms + numAttribs;
+
+   // Keep the table at most half full
+   while ( tableSize < (GLuint)numVariables * 2 )
+      tableSize *= 2;
+
+   reflection->variables = (ESShaderVariable *)malloc ( sizeof(ESShaderVariable) * ( numVariables + 1 ) );
+   reflection->table = (GLushort *)calloc ( tableSize, sizeof(GLushort) );
+   reflection->names = (char *)malloc ( (size_t)maxNameLen * ( numVariables + 1 ) );
+   if ( reflection->variables == NULL || reflection->table == NULL || reflection->names == NULL )
+   {
+      esReflectionFree ( reflection );
+      return GL_FALSE;
+   }
+   reflection->tableMask = tableSize - 1;
+
+   name = reflection->names;
+   for ( i = 0; i < numVariables; i++ )
+   {
+      ESShaderVariable *variable = &reflection->variables[i];
+      GLsizei length = 0;
+      GLuint slot;
+      char *bracket;
+
+      if ( i < numUniforms )
+      {
+         glGetActiveUniform ( program, i, maxNameLen, &length, &variable->size, &variable->type, name );
+         name[length] = '\0';
+
+         // Arrays are reported as "name[0]"
+         bracket = strchr ( name, '[' );
+         if ( bracket != NULL )
+            *bracket = '\0';
+
+         variable->location = glGetUniformLocation ( program, name );
+         variable->valueOffset = numWords;
+         numWords += typeWords ( variable->type ) * variable->size;
+      }
+      else
+      {
+         glGetActiveAttrib ( program, i - numUniforms, maxNameLen, &length, &variable->size, &variable->type, name );
+         name[length] = '\0';
+
+         variable->location = glGetAttribLocation ( program, name );
+         variable->valueOffset = 0;
+      }
+
+      variable->name = name;
+      name += strlen ( name ) + 1;
+
+      for ( slot = hashName ( variable->name ) & reflection->tableMask; reflection->table[slot] != 0;
+            slot = ( slot + 1 ) & reflection->tableMask )
+         ;
+      reflection->table[slot] = (GLushort)( i + 1 );
+   }
+
+   // Uniforms are zero after a successful link
+   reflection->values = (GLuint *)calloc ( numWords + 1, sizeof(GLuint) );
+   reflection->known = (unsigned char *)malloc ( numUniforms + 1 );
+   if ( reflection->values == NULL || reflection->known == NULL )
+   {
+      esReflectionFree ( reflection );
+      return GL_FALSE;
+   }
+   memset ( reflection->known, 1, numUniforms + 1 );
+   reflection->epoch = invalidateEpoch;
+
+   reflection->numUniforms = numUniforms;
+   reflection->numAttribs = numAttribs;
+   return GL_TRUE;
+}
+
+void ESUTIL_API esReflectionFree ( ESReflection *reflection )
+{
+   free ( reflection->variables );
+   free ( reflection->table );
+   free ( reflection->values );
+   free ( reflection->known );
+   free ( reflection->names );
+   memset ( reflection, 0, sizeof(ESReflection) );
+}
+
+void ESUTIL_API esReflectionInvalidate ( ESReflection *reflection )
+{
+   if ( reflection == NULL )
+   {
+      invalidateEpoch++;
+      return;
+   }
+
+   if ( reflection->known != NULL )
+      memset ( reflection->known, 0, reflection->numUniforms + 1 );
+   reflection->epoch = invalidateEpoch;
+}
+
+ESShaderVariable * ESUTIL_API esReflectionUniform ( const ESReflection *reflection, const char *name )
+{
+   return lookup ( reflection, name, 0, reflection->numUniforms );
+}
+
+ESShaderVariable * ESUTIL_API esReflectionAttrib ( const ESReflection *reflection, const char *name )
+{
+   return lookup ( reflection, name, reflection->numUniforms, reflection->numUniforms + reflection->numAttribs );
+}
+
+void ESUTIL_API esSetUniformfv ( ESReflection *reflection, const ESShaderVariable *uniform, GLsizei count,
+                                 const GLfloat *value )
+{
+   if ( uniform != NULL && isFloatType ( uniform->type ) )
+      setUniform ( reflection, uniform, count, value );
+}
+
+void ESUTIL_API esSetUniformiv ( ESReflection *reflection, const ESShaderVariable *uniform, GLsizei count,
+                                 const GLint *value )
+{
+   if ( uniform != NULL && !isFloatType ( uniform->type ) )
+      setUniform ( reflection, uniform, count, value );
+}
+
+void ESUTIL_API esSetUniform1f ( ESReflection *reflection, const ESShaderVariable *uniform, GLfloat value )
+{
+   if ( uniform != NULL && typeWords ( uniform->type ) == 1 )
+      esSetUniformfv ( reflection, uniform, 1, &value );
+}
+
+void ESUTIL_API esSetUniform1i ( ESReflection *reflection, const ESShaderVariable *uniform, GLint value )
+{
+   if ( uniform != NULL && typeWords ( uniform->type ) == 1 )
+      esSetUniformiv ( reflection, uniform, 1, &value );
+}
@@ -0,0 +1,194 @@
+// esRenderQueue.c
+//
+//    Deferred draw submission.  Draw items are pushed with a 64-bit sort
+//    key, radix sorted and then executed in key order, so items sharing a
+//    program, material and buffer are drawn together.
+//
+//    Key layout, most significant bits first:
+//
+//       opaque:      layer:4 | 0 | program:10 | material:12 | buffer:12 | depth:24 | 0
+//       translucent: layer:4 | 1 | depth:24 (inverted) | program:10 | material:12 | buffer:12 | 0
+//
+//    Layers draw in order and opaque items draw before translucent ones.
+//    Opaque items are grouped by state and drawn front-to-back within a
+//    group; translucent items must be blended back-to-front, so depth takes
+//    priority over state for them.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEPTH_BITS      24
+#define BUFFER_BITS     12
+#define MATERIAL_BITS   12
+#define PROGRAM_BITS    10
+
+#define TRANSLUCENT_BIT ( (ESSortKey)1 << 59 )
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static ESSortKey field ( GLuint value, int bits )
+{
+   return (ESSortKey)( value & ( ( 1u << bits ) - 1 ) );
+}
+
+//
+// LSD radix sort on 8-bit digits.  All eight histograms are built in one
+// pass, and digits where every key has the same value are skipped, which
+// is most of them when few layers and programs are in use.
+//
+static void radixSort ( ESRenderItem *items, ESRenderItem *scratch, int count )
+{
+   int histogram[8][256];
+   ESRenderItem *src = items;
+   ESRenderItem *dst = scratch;
+   int pass, i;
+
+   memset ( histogram, 0, sizeof(histogram) );
+   for ( i = 0; i < count; i++ )
+   {
+      ESSortKey key = items[i].key;
+
+      for ( pass = 0; pass < 8; pass++ )
+         histogram[pass][( key >> ( pass * 8 ) ) & 0xFF]++;
+   }
+
+   for ( pass = 0; pass < 8; pass++ )
+   {
+      int *h = histogram[pass];
+      int shift = pass * 8;
+      int offset = 0;
+      ESRenderItem *tmp;
+
+      if ( h[( src[0].key >> shift ) & 0xFF] == count )
+         continue;
+
+      for ( i = 0; i < 256; i++ )
+      {
+         int n = h[i];
+         h[i] = offset;
+         offset += n;
+      }
+
+      for ( i = 0; i < count; i++ )
+         dst[h[( src[i].key >> shift ) & 0xFF]++] = src[i];
+
+      tmp = src;
+      src = dst;
+      dst = tmp;
+   }
+
+   if ( src != items )
+      memcpy ( items, src, sizeof(ESRenderItem) * count );
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+ESSortKey ESUTIL_API esMakeSortKey ( GLuint layer, GLboolean translucent, GLuint program,
+                                     GLuint material, GLuint buffer, float depth )
+{
+   ESSortKey state;
+   ESSortKey z;
+
+   depth = depth < 0.0f ? 0.0f : ( depth > 1.0f ? 1.0f : depth );
+   z = (ESSortKey)( depth * (float)( ( 1 << DEPTH_BITS ) - 1 ) );
+
+   state = ( field ( program, PROGRAM_BITS ) << ( MATERIAL_BITS + BUFFER_BITS ) ) |
+           ( field ( material, MATERIAL_BITS ) << BUFFER_BITS ) |
+           field ( buffer, BUFFER_BITS );
+
+   if ( translucent )
+   {
+      z = ( ( 1 << DEPTH_BITS ) - 1 ) - z;
+      return ( field ( layer, 4 ) << 60 ) | TRANSLUCENT_BIT |
+             ( z << ( 59 - DEPTH_BITS ) ) | ( state << 1 );
+   }
+
+   return ( field ( layer, 4 ) << 60 ) | ( state << ( 1 + DEPTH_BITS ) ) | ( z << 1 );
+}
+
+GLboolean ESUTIL_API esRenderQueueInit ( ESRenderQueue *queue, int capacity )
+{
+   memset ( queue, 0, sizeof(ESRenderQueue) );
+
+   queue->items = (ESRenderItem *)malloc ( sizeof(ESRenderItem) * capacity );
+   queue->scratch = (ESRenderItem *)malloc ( sizeof(ESRenderItem) * capacity );
+   if ( queue->items == NULL || queue->scratch == NULL )
+   {
+      esRenderQueueFree ( queue );
+      return GL_FALSE;
+   }
+
+   queue->capacity = capacity;
+   return GL_TRUE;
+}
+
+void ESUTIL_API esRenderQueueFree ( ESRenderQueue *queue )
+{
+   free ( queue->items );
+   free ( queue->scratch );
+   memset ( queue, 0, sizeof(ESRenderQueue) );
+}
+
+GLboolean ESUTIL_API esRenderQueuePush ( ESRenderQueue *queue, ESSortKey key, GLuint program,
+                                         void (ESCALLBACK *drawFunc) ( void * ), void *data )
+{
+   ESRenderItem *item;
+
+   if ( queue->count >= queue->capacity )
+      return GL_FALSE;
+
+   item = &queue->items[queue->count++];
+   item->key = key;
+   item->program = program;
+   item->drawFunc = drawFunc;
+   item->data = data;
+   return GL_TRUE;
+}
+
+void ESUTIL_API esRenderQueueSort ( ESRenderQueue *queue )
+{
+   if ( queue->count > 1 )
+      radixSort ( queue->items, queue->scratch, queue->count );
+}
+
+void ESUTIL_API esRenderQueueSubmit ( ESRenderQueue *queue )
+{
+   int i;
+
+   esRenderQueueSort ( queue );
+
+   for ( i = 0; i < queue->count; i++ )
+   {
+      const ESRenderItem *item = &queue->items[i];
+
+      // Translucent items blend over what is already drawn without writing depth
+      if ( item->key & TRANSLUCENT_BIT )
+      {
+         esStateEnable ( GL_BLEND );
+         esStateDepthMask ( GL_FALSE );
+      }
+      else
+      {
+         esStateDisable ( GL_BLEND );
+         esStateDepthMask ( GL_TRUE );
+      }
+
+      esStateUseProgram ( item->program );
+      item->drawFunc ( item->data );
+   }
+
+   queue->count = 0;
+}
@@ -0,0 +1,337 @@
+// esResolution.c
+//
+//    Dynamic resolution.  The scene is rendered into the lower left
+//    renderWidth x renderHeight corner of an offscreen target the size of
+//    the window and stretched over the window with one textured quad.
+//    Changing the scale only moves the viewport, so the target is only
+//    reallocated when the window size changes.
+//
+//    Frames are timed on the GPU with EXT_disjoint_timer_query.  Results
+//    arrive a few frames late and are read without waiting.  Without the
+//    extension the frame interval is used instead, which cannot show spare
+//    time below the display refresh.  The scale drops after a few frames
+//    over budget and rises slowly after many frames with headroom.  Every
+//    drop doubles the headroom needed before the next rise, so a scale that
+//    only fits with vsync to spare settles instead of oscillating.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Frames in a row before the scale goes down or up
+#define OVER_BUDGET_FRAMES    8
+#define UNDER_BUDGET_FRAMES   60
+
+// Over budget above target * OVER_BUDGET; headroom below target * HEADROOM
+#define OVER_BUDGET           1.05f
+#define HEADROOM              0.8f
+
+#define SCALE_STEP_UP         0.05f
+
+// Longest wait before rising again after repeated drops, about 30 s at 60 Hz
+#define MAX_UNDER_BUDGET_FRAMES  1920
+
+static PFNGLGENQUERIESEXTPROC genQueries = NULL;
+static PFNGLDELETEQUERIESEXTPROC deleteQueries = NULL;
+static PFNGLBEGINQUERYEXTPROC beginQuery = NULL;
+static PFNGLENDQUERYEXTPROC endQuery = NULL;
+static PFNGLGETQUERYOBJECTUIVEXTPROC getQueryObjectuiv = NULL;
+static PFNGLGETQUERYOBJECTUI64VEXTPROC getQueryObjectui64v = NULL;
+
+static const char upscaleVertexShader[] =
+   "attribute vec2 aPosition;\n"
+   "uniform vec2 uScale;\n"
+   "varying vec2 vTexCoord;\n"
+   "void main()\n"
+   "{\n"
+   "   vTexCoord = ( aPosition * 0.5 + 0.5 ) * uScale;\n"
+   "   gl_Position = vec4 ( aPosition, 0.0, 1.0 );\n"
+   "}\n";
+
+static const char upscaleFragmentShader[] =
+   "precision mediump float;\n"
+   "uniform sampler2D uTexture;\n"
+   "uniform vec2 uMaxTexCoord;\n"
+   "varying vec2 vTexCoord;\n"
+   "void main()\n"
+   "{\n"
+   "   gl_FragColor = texture2D ( uTexture, min ( vTexCoord, uMaxTexCoord ) );\n"
+   "}\n";
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static GLboolean loadTimerQueries ( void )
+{
+   if ( genQueries != NULL && getQueryObjectui64v != NULL )
+      return GL_TRUE;
+
+   if ( !esHasExtension ( "GL_EXT_disjoint_timer_query" ) )
+      return GL_FALSE;
+
+   genQueries = (PFNGLGENQUERIESEXTPROC)eglGetProcAddress ( "glGenQueriesEXT" );
+   deleteQueries = (PFNGLDELETEQUERIESEXTPROC)eglGetProcAddress ( "glDeleteQueriesEXT" );
+   beginQuery = (PFNGLBEGINQUERYEXTPROC)eglGetProcAddress ( "glBeginQueryEXT" );
+   endQuery = (PFNGLENDQUERYEXTPROC)eglGetProcAddress ( "glEndQueryEXT" );
+   getQueryObjectuiv = (PFNGLGETQUERYOBJECTUIVEXTPROC)eglGetProcAddress ( "glGetQueryObjectuivEXT" );
+   getQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress ( "glGetQueryObjectui64vEXT" );
+   return genQueries != NULL && deleteQueries != NULL && beginQuery != NULL && endQuery != NULL &&
+          getQueryObjectuiv != NULL && getQueryObjectui64v != NULL;
+}
+
+//
+// (Re)allocate the offscreen target at the window size
+//
+static void resizeTarget ( ESDynamicResolution *dr, GLint width, GLint height )
+{
+   esStateBindTexture ( GL_TEXTURE_2D, dr->colorTexture );
+   glTexImage2D ( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+
+   if ( dr->depthRenderbuffer != 0 )
+   {
+      glBindRenderbuffer ( GL_RENDERBUFFER, dr->depthRenderbuffer );
+      glRenderbufferStorage ( GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height );
+   }
+
+   glBindFramebuffer ( GL_FRAMEBUFFER, dr->framebuffer );
+   glFramebufferTexture2D ( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dr->colorTexture, 0 );
+   if ( dr->depthRenderbuffer != 0 )
+      glFramebufferRenderbuffer ( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, dr->depthRenderbuffer );
+
+   if ( glCheckFramebufferStatus ( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+      esLogMessage ( "Dynamic resolution target %dx%d is incomplete\n", width, height );
+
+   dr->width = width;
+   dr->height = height;
+}
+
+//
+// Update the smoothed frame time and change the scale once it has been
+// over budget, or had headroom, for long enough
+//
+static void adjustScale ( ESDynamicResolution *dr, float frameTime, float headroom )
+{
+   float scale = dr->scale;
+
+   // A rise that held for twice the wait earns back half of the back-off
+   if ( dr->framesSinceRise >= 0 && ++dr->framesSinceRise > dr->riseFrames * 2 )
+   {
+      dr->riseFrames = dr->riseFrames / 2 > UNDER_BUDGET_FRAMES ? dr->riseFrames / 2 : UNDER_BUDGET_FRAMES;
+      dr->framesSinceRise = -1;
+   }
+
+   dr->frameTime = dr->frameTime > 0.0f ? dr->frameTime * 0.9f + frameTime * 0.1f : frameTime;
+
+   if ( dr->frameTime > dr->targetTime * OVER_BUDGET )
+   {
+      dr->underBudgetFrames = 0;
+      if ( ++dr->overBudgetFrames >= OVER_BUDGET_FRAMES )
+      {
+         // Pixel count, and roughly fill cost, goes with the square of the scale
+         float factor = sqrtf ( dr->targetTime / dr->frameTime );
+         scale *= factor < 0.8f ? 0.8f : ( factor > 0.95f ? 0.95f : factor );
+      }
+   }
+   else if ( dr->frameTime < dr->targetTime * headroom )
+   {
+      dr->overBudgetFrames = 0;
+      if ( ++dr->underBudgetFrames >= dr->riseFrames )
+         scale += SCALE_STEP_UP;
+   }
+   else
+   {
+      dr->overBudgetFrames = 0;
+      dr->underBudgetFrames = 0;
+   }
+
+   scale = scale < dr->minScale ? dr->minScale : ( scale > dr->maxScale ? dr->maxScale : scale );
+   if ( scale < dr->scale )
+   {
+      dr->riseFrames = dr->riseFrames * 2 < MAX_UNDER_BUDGET_FRAMES ? dr->riseFrames * 2 : MAX_UNDER_BUDGET_FRAMES;
+      dr->framesSinceRise = -1;
+   }
+   else if ( scale > dr->scale )
+      dr->framesSinceRise = 0;
+
+   if ( scale != dr->scale )
+   {
+      // Timings from before the change no longer apply
+      dr->scale = scale;
+      dr->frameTime = 0.0f;
+      dr->overBudgetFrames = 0;
+      dr->underBudgetFrames = 0;
+   }
+}
+
+//
+// Read finished timer queries, oldest first, without waiting for the rest
+//
+static void readTimerQueries ( ESDynamicResolution *dr )
+{
+   GLint disjoint = GL_FALSE;
+
+   // A disjoint event, e.g. a clock change, invalidates every query in flight
+   glGetIntegerv ( GL_GPU_DISJOINT_EXT, &disjoint );
+
+   while ( dr->numQueries > 0 )
+   {
+      GLuint query = dr->queries[dr->firstQuery];
+      GLuint available = GL_FALSE;
+      GLuint64 elapsed = 0;
+
+      if ( !disjoint )
+      {
+         getQueryObjectuiv ( query, GL_QUERY_RESULT_AVAILABLE_EXT, &available );
+         if ( !available )
+            break;
+
+         getQueryObjectui64v ( query, GL_QUERY_RESULT_EXT, &elapsed );
+         adjustScale ( dr, (float)( elapsed * 1e-9 ), HEADROOM );
+      }
+
+      dr->firstQuery = ( dr->firstQuery + 1 ) % ES_RESOLUTION_QUERIES;
+      dr->numQueries--;
+   }
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+GLboolean ESUTIL_API esDynamicResolutionInit ( ESDynamicResolution *dr, float targetTime, float minScale,
+                                               GLboolean depth )
+{
+   static const GLfloat quad[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+   memset ( dr, 0, sizeof(ESDynamicResolution) );
+
+   dr->program = esLoadProgram ( upscaleVertexShader, upscaleFragmentShader );
+   if ( dr->program == 0 || !esReflectionInit ( &dr->reflection, dr->program ) )
+   {
+      esDynamicResolutionFree ( dr );
+      return GL_FALSE;
+   }
+   dr->positionLoc = glGetAttribLocation ( dr->program, "aPosition" );
+   dr->scaleUniform = esReflectionUniform ( &dr->reflection, "uScale" );
+   dr->maxTexCoordUniform = esReflectionUniform ( &dr->reflection, "uMaxTexCoord" );
+
+   glGenBuffers ( 1, &dr->quadBuffer );
+   esStateBindBuffer ( GL_ARRAY_BUFFER, dr->quadBuffer );
+   glBufferData ( GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW );
+
+   glGenFramebuffers ( 1, &dr->framebuffer );
+   glGenTextures ( 1, &dr->colorTexture );
+   esStateBindTexture ( GL_TEXTURE_2D, dr->colorTexture );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTexParameteri ( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+   if ( depth )
+      glGenRenderbuffers ( 1, &dr->depthRenderbuffer );
+
+   dr->timerQueries = loadTimerQueries ( );
+   if ( dr->timerQueries )
+      genQueries ( ES_RESOLUTION_QUERIES, dr->queries );
+
+   dr->targetTime = targetTime;
+   dr->minScale = minScale > 0.0f && minScale < 1.0f ? minScale : 1.0f;
+   dr->maxScale = 1.0f;
+   dr->scale = 1.0f;
+   dr->riseFrames = UNDER_BUDGET_FRAMES;
+   dr->framesSinceRise = -1;
+   return GL_TRUE;
+}
+
+void ESUTIL_API esDynamicResolutionFree ( ESDynamicResolution *dr )
+{
+   if ( dr->timerQueries )
+      deleteQueries ( ES_RESOLUTION_QUERIES, dr->queries );
+   if ( dr->depthRenderbuffer != 0 )
+      glDeleteRenderbuffers ( 1, &dr->depthRenderbuffer );
+   if ( dr->colorTexture != 0 )
+      glDeleteTextures ( 1, &dr->colorTexture );
+   if ( dr->framebuffer != 0 )
+      glDeleteFramebuffers ( 1, &dr->framebuffer );
+   if ( dr->quadBuffer != 0 )
+      esStateDeleteBuffers ( 1, &dr->quadBuffer );
+   if ( dr->program != 0 )
+      esStateDeleteProgram ( dr->program );
+   esReflectionFree ( &dr->reflection );
+   memset ( dr, 0, sizeof(ESDynamicResolution) );
+}
+
+void ESUTIL_API esDynamicResolutionBegin ( ESDynamicResolution *dr, ESContext *esContext )
+{
+   if ( esContext->width != dr->width || esContext->height != dr->height )
+      resizeTarget ( dr, esContext->width, esContext->height );
+
+   dr->renderWidth = (GLint)( dr->width * dr->scale + 0.5f );
+   dr->renderHeight = (GLint)( dr->height * dr->scale + 0.5f );
+   if ( dr->renderWidth < 1 )
+      dr->renderWidth = 1;
+   if ( dr->renderHeight < 1 )
+      dr->renderHeight = 1;
+
+   glBindFramebuffer ( GL_FRAMEBUFFER, dr->framebuffer );
+   esStateViewport ( 0, 0, dr->renderWidth, dr->renderHeight );
+
+   // Skip timing this frame if every query is still waiting for its result
+   if ( dr->timerQueries && dr->numQueries < ES_RESOLUTION_QUERIES )
+      beginQuery ( GL_TIME_ELAPSED_EXT,
+                   dr->queries[( dr->firstQuery + dr->numQueries ) % ES_RESOLUTION_QUERIES] );
+}
+
+void ESUTIL_API esDynamicResolutionEnd ( ESDynamicResolution *dr, ESContext *esContext )
+{
+   GLfloat scale[2];
+   GLfloat maxTexCoord[2];
+
+   if ( dr->timerQueries && dr->numQueries < ES_RESOLUTION_QUERIES )
+   {
+      endQuery ( GL_TIME_ELAPSED_EXT );
+      dr->numQueries++;
+   }
+
+   // Stretch the rendered corner over the window, clamping to its last texel centers
+   // so filtering never reads the unrendered part of the target
+   glBindFramebuffer ( GL_FRAMEBUFFER, 0 );
+   esStateViewport ( 0, 0, esContext->width, esContext->height );
+   esStateDisable ( GL_DEPTH_TEST );
+   esStateDisable ( GL_BLEND );
+
+   scale[0] = (GLfloat)dr->renderWidth / dr->width;
+   scale[1] = (GLfloat)dr->renderHeight / dr->height;
+   maxTexCoord[0] = ( dr->renderWidth - 0.5f ) / dr->width;
+   maxTexCoord[1] = ( dr->renderHeight - 0.5f ) / dr->height;
+
+   esStateUseProgram ( dr->program );
+   esSetUniformfv ( &dr->reflection, dr->scaleUniform, 1, scale );
+   esSetUniformfv ( &dr->reflection, dr->maxTexCoordUniform, 1, maxTexCoord );
+   esStateActiveTexture ( GL_TEXTURE0 );
+   esStateBindTexture ( GL_TEXTURE_2D, dr->colorTexture );
+
+   esStateBindBuffer ( GL_ARRAY_BUFFER, dr->quadBuffer );
+   esStateVertexAttribPointer ( dr->positionLoc, 2, GL_FLOAT, GL_FALSE, 0, (char *)0 );
+   esStateEnableVertexAttribArray ( dr->positionLoc );
+   glDrawArrays ( GL_TRIANGLE_STRIP, 0, 4 );
+
+   if ( dr->timerQueries )
+      readTimerQueries ( dr );
+   else if ( esContext->deltatime > 0.0f )
+   {
+      // Vsync hides spare time, so every frame within budget counts as headroom
+      adjustScale ( dr, esContext->deltatime, OVER_BUDGET );
+   }
+}
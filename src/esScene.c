@@ -0,0 +1,227 @@
+// esScene.c
+//
+//    Flat transform hierarchy.  Nodes are stored in arrays ordered so that
+//    every parent comes before its children, which lets world matrices be
+//    updated in a single forward pass.  Only nodes whose local transform
+//    changed, and their descendants, are recomputed.
+//
+//    Multi-threaded updates run on the esTaskRun worker pool.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ES_SCENE_DIRTY    1
+#define ES_SCENE_CHANGED  2
+
+typedef struct
+{
+    ESSceneTransforms *scene;
+    int                updated[ES_MAX_THREADS];
+} UpdateJob;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+//
+// Recompute the world matrix of node i if it or its parent changed
+//
+static int updateNode(ESSceneTransforms *scene, int i)
+{
+    int parent = scene->parent[i];
+
+    if ( (scene->flags[i] & ES_SCENE_DIRTY) || (parent >= 0 && (scene->flags[parent] & ES_SCENE_CHANGED)) )
+    {
+        ESMatrix local;
+
+        esComposeTRS(&local, &scene->position[i], &scene->rotation[i], &scene->scale[i]);
+        if ( parent >= 0 )
+            esMatrixMultiply(&scene->world[i], &local, &scene->world[parent]);
+        else
+            scene->world[i] = local;
+
+        scene->flags[i] = ES_SCENE_CHANGED;
+        return 1;
+    }
+
+    scene->flags[i] = 0;
+    return 0;
+}
+
+//
+// Split the nodes into numThreads ranges of scene->order.  Whole root
+// subtrees are handed to the least loaded thread, so a node and all of its
+// ancestors land in the same range, in parent-before-child order, and no
+// thread reads a matrix another thread is writing.  Only redone when nodes
+// are added or the thread count changes.
+//
+static GLboolean partition(ESSceneTransforms *scene, int numThreads)
+{
+    int  load[ES_MAX_THREADS];
+    int  next[ES_MAX_THREADS];
+    int *owner;
+    int  i, t;
+
+    if ( scene->rangeCount == scene->count && scene->rangeThreads == numThreads )
+        return GL_TRUE;
+
+    owner = (int *)calloc(scene->count + 1, sizeof(int));
+    if ( !owner )
+        return GL_FALSE;
+
+    // Subtree sizes, accumulated on the root node
+    for (i = 0; i < scene->count; i++)
+        owner[scene->root[i]]++;
+
+    for (t = 0; t < numThreads; t++)
+        load[t] = 0;
+
+    for (i = 0; i < scene->count; i++)
+    {
+        int best = 0;
+
+        if ( scene->parent[i] >= 0 )
+            continue;
+
+        for (t = 1; t < numThreads; t++)
+            if ( load[t] < load[best] )
+                best = t;
+        load[best] += owner[i];
+        owner[i] = best;
+    }
+
+    scene->ranges[0] = 0;
+    for (t = 0; t < numThreads; t++)
+    {
+        next[t] = scene->ranges[t];
+        scene->ranges[t + 1] = scene->ranges[t] + load[t];
+    }
+
+    for (i = 0; i < scene->count; i++)
+        scene->order[next[owner[scene->root[i]]]++] = i;
+
+    free(owner);
+    scene->rangeCount = scene->count;
+    scene->rangeThreads = numThreads;
+    return GL_TRUE;
+}
+
+static void ESCALLBACK updateTask(int thread, void *arg)
+{
+    UpdateJob         *job = (UpdateJob *)arg;
+    ESSceneTransforms *scene = job->scene;
+    int                updated = 0;
+    int                k;
+
+    for (k = scene->ranges[thread]; k < scene->ranges[thread + 1]; k++)
+        updated += updateNode(scene, scene->order[k]);
+
+    job->updated[thread] = updated;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+GLboolean ESUTIL_API esSceneInit(ESSceneTransforms *scene, int capacity)
+{
+    memset(scene, 0, sizeof(ESSceneTransforms));
+
+    scene->parent   = (int *)malloc(sizeof(int) * capacity);
+    scene->root     = (int *)malloc(sizeof(int) * capacity);
+    scene->flags    = (unsigned char *)malloc(sizeof(unsigned char) * capacity);
+    scene->position = (ESVec3 *)malloc(sizeof(ESVec3) * capacity);
+    scene->rotation = (ESQuaternion *)malloc(sizeof(ESQuaternion) * capacity);
+    scene->scale    = (ESVec3 *)malloc(sizeof(ESVec3) * capacity);
+    scene->world    = (ESMatrix *)malloc(sizeof(ESMatrix) * capacity);
+    scene->order    = (int *)malloc(sizeof(int) * capacity);
+
+    if ( !scene->parent || !scene->root || !scene->flags || !scene->position ||
+         !scene->rotation || !scene->scale || !scene->world || !scene->order )
+    {
+        esSceneFree(scene);
+        return GL_FALSE;
+    }
+
+    scene->capacity = capacity;
+    return GL_TRUE;
+}
+
+void ESUTIL_API esSceneFree(ESSceneTransforms *scene)
+{
+    free(scene->parent);
+    free(scene->root);
+    free(scene->flags);
+    free(scene->position);
+    free(scene->rotation);
+    free(scene->scale);
+    free(scene->world);
+    free(scene->order);
+    memset(scene, 0, sizeof(ESSceneTransforms));
+}
+
+int ESUTIL_API esSceneAddNode(ESSceneTransforms *scene, int parent)
+{
+    int node = scene->count;
+
+    if ( node >= scene->capacity || parent >= node )
+        return -1;
+
+    scene->parent[node] = parent < 0 ? -1 : parent;
+    scene->root[node] = parent < 0 ? node : scene->root[parent];
+    scene->flags[node] = ES_SCENE_DIRTY;
+
+    scene->position[node].x = scene->position[node].y = scene->position[node].z = 0.0f;
+    scene->rotation[node].x = scene->rotation[node].y = scene->rotation[node].z = 0.0f;
+    scene->rotation[node].w = 1.0f;
+    scene->scale[node].x = scene->scale[node].y = scene->scale[node].z = 1.0f;
+    esMatrixLoadIdentity(&scene->world[node]);
+
+    scene->count++;
+    return node;
+}
+
+void ESUTIL_API esSceneSetLocal(ESSceneTransforms *scene, int node, const ESVec3 *pos,
+                                const ESQuaternion *rot, const ESVec3 *scale)
+{
+    if ( pos )
+        scene->position[node] = *pos;
+    if ( rot )
+        scene->rotation[node] = *rot;
+    if ( scale )
+        scene->scale[node] = *scale;
+    scene->flags[node] |= ES_SCENE_DIRTY;
+}
+
+int ESUTIL_API esSceneUpdate(ESSceneTransforms *scene, int numThreads)
+{
+    UpdateJob job;
+    int       updated = 0;
+    int       t;
+
+    if ( numThreads > ES_MAX_THREADS )
+        numThreads = ES_MAX_THREADS;
+
+    if ( numThreads <= 1 || !partition(scene, numThreads) )
+    {
+        for (t = 0; t < scene->count; t++)
+            updated += updateNode(scene, t);
+        return updated;
+    }
+
+    job.scene = scene;
+    esTaskRun(numThreads, updateTask, &job);
+
+    for (t = 0; t < numThreads; t++)
+        updated += job.updated[t];
+    return updated;
+}
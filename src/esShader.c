@@ -18,6 +18,12 @@
 //
 #include "esUtil.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __EMSCRIPTEN__
+#include <GLES2/gl2ext.h>
+#endif
 
 //////////////////////////////////////////////////////////////////
 //
@@ -25,6 +31,332 @@
 //
 //
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+static ESProgram programCache[ES_PROGRAM_CACHE_SIZE];
+static int numCachedPrograms = 0;
+
+static ESShaderVariant variantCache[ES_VARIANT_CACHE_SIZE];
+static int numCachedVariants = 0;
+
+#ifndef __EMSCRIPTEN__
+#define BINARY_FILE_MAGIC    0x42505345  // "ESPB"
+#define BINARY_FILE_VERSION  1
+
+typedef struct
+{
+   GLuint              magic;
+   GLuint              version;
+   unsigned long long  driverHash;
+   unsigned long long  sourceHash;
+   GLenum              format;
+   GLint               length;
+} BinaryFileHeader;
+
+static char binaryCachePath[256];
+static int binaryCacheSupported = -1;
+static unsigned long long driverHash;
+static PFNGLGETPROGRAMBINARYOESPROC getProgramBinary;
+static PFNGLPROGRAMBINARYOESPROC programBinary;
+#endif
+
+//
+// 64-bit FNV-1a, continued from hash; the terminating zero is included so
+// that ( "ab", "c" ) and ( "a", "bc" ) hash differently
+//
+static unsigned long long hashString ( unsigned long long hash, const char *str )
+{
+   do
+   {
+      hash ^= (unsigned char)*str;
+      hash *= 1099511628211ULL;
+   } while ( *str++ != '\0' );
+
+   return hash;
+}
+
+static void logShaderError ( GLuint shader )
+{
+   GLint compiled = GL_FALSE;
+   GLint infoLen = 0;
+
+   glGetShaderiv ( shader, GL_COMPILE_STATUS, &compiled );
+   glGetShaderiv ( shader, GL_INFO_LOG_LENGTH, &infoLen );
+   if ( !compiled && infoLen > 1 )
+   {
+      char* infoLog = (char *)malloc ( sizeof(char) * infoLen );
+
+      glGetShaderInfoLog ( shader, infoLen, NULL, infoLog );
+      esLogMessage ( "Error compiling shader:\n%s\n", infoLog );
+      free ( infoLog );
+   }
+}
+
+//
+// Check a program whose link has finished, logging errors and releasing
+// the shaders either way
+//
+static void finishProgram ( ESProgram *entry )
+{
+   GLint linked;
+
+   glGetProgramiv ( entry->program, GL_LINK_STATUS, &linked );
+
+   if ( !linked )
+   {
+      GLint infoLen = 0;
+
+      logShaderError ( entry->vertexShader );
+      logShaderError ( entry->fragmentShader );
+
+      glGetProgramiv ( entry->program, GL_INFO_LOG_LENGTH, &infoLen );
+      if ( infoLen > 1 )
+      {
+         char* infoLog = (char *)malloc ( sizeof(char) * infoLen );
+
+         glGetProgramInfoLog ( entry->program, infoLen, NULL, infoLog );
+         esLogMessage ( "Error linking program:\n%s\n", infoLog );
+         free ( infoLog );
+      }
+
+      esStateDeleteProgram ( entry->program );
+      entry->program = 0;
+      entry->status = ES_PROGRAM_FAILED;
+   }
+   else
+   {
+      // Reflect once here so draw code never queries locations
+      entry->reflection = (ESReflection *)malloc ( sizeof(ESReflection) );
+      if ( entry->reflection != NULL && !esReflectionInit ( entry->reflection, entry->program ) )
+      {
+         free ( entry->reflection );
+         entry->reflection = NULL;
+      }
+      entry->status = ES_PROGRAM_READY;
+   }
+
+   // Attached shaders are only flagged for deletion until the program goes
+   glDeleteShader ( entry->vertexShader );
+   glDeleteShader ( entry->fragmentShader );
+   entry->vertexShader = 0;
+   entry->fragmentShader = 0;
+}
+
+#ifndef __EMSCRIPTEN__
+//
+// Program binaries are only valid for the driver that produced them, so the
+// vendor, renderer and version strings are hashed into every cache file
+//
+static GLboolean binaryCacheEnabled ( void )
+{
+   if ( binaryCachePath[0] == '\0' )
+      return GL_FALSE;
+
+   if ( binaryCacheSupported < 0 )
+   {
+      GLint numFormats = 0;
+
+      binaryCacheSupported = 0;
+      if ( esHasExtension ( "GL_OES_get_program_binary" ) )
+      {
+         glGetIntegerv ( GL_NUM_PROGRAM_BINARY_FORMATS_OES, &numFormats );
+         getProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress ( "glGetProgramBinaryOES" );
+         programBinary = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress ( "glProgramBinaryOES" );
+      }
+
+      if ( numFormats > 0 && getProgramBinary != NULL && programBinary != NULL )
+      {
+         const GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+         int i;
+
+         driverHash = 14695981039346656037ULL;
+         for ( i = 0; i < 3; i++ )
+         {
+            const char *str = (const char *)glGetString ( names[i] );
+            driverHash = hashString ( driverHash, str != NULL ? str : "" );
+         }
+         binaryCacheSupported = 1;
+      }
+   }
+
+   return binaryCacheSupported == 1;
+}
+
+static void binaryFileName ( char *name, size_t size, unsigned long long sourceHash )
+{
+   snprintf ( name, size, "%s/program_%016llx.bin", binaryCachePath, sourceHash );
+}
+
+//
+// Create a program from a cached binary.  Files written by another driver
+// are ignored and later overwritten by saveProgramBinary.
+//
+static GLuint loadProgramBinary ( unsigned long long sourceHash )
+{
+   BinaryFileHeader header;
+   char name[320];
+   void *binary = NULL;
+   GLuint programObject = 0;
+   FILE *file;
+
+   if ( !binaryCacheEnabled ( ) )
+      return 0;
+
+   binaryFileName ( name, sizeof(name), sourceHash );
+   file = fopen ( name, "rb" );
+   if ( file == NULL )
+      return 0;
+
+   if ( fread ( &header, sizeof(header), 1, file ) == 1 &&
+        header.magic == BINARY_FILE_MAGIC && header.version == BINARY_FILE_VERSION &&
+        header.driverHash == driverHash && header.sourceHash == sourceHash && header.length > 0 )
+   {
+      binary = malloc ( header.length );
+      if ( binary != NULL && fread ( binary, header.length, 1, file ) == 1 )
+      {
+         GLint linked = GL_FALSE;
+
+         programObject = glCreateProgram ( );
+         programBinary ( programObject, header.format, binary, header.length );
+
+         // A driver update can reject binaries even with unchanged strings
+         glGetProgramiv ( programObject, GL_LINK_STATUS, &linked );
+         if ( !linked )
+         {
+            esStateDeleteProgram ( programObject );
+            programObject = 0;
+         }
+      }
+   }
+
+   free ( binary );
+   fclose ( file );
+   return programObject;
+}
+
+static void saveProgramBinary ( GLuint programObject, unsigned long long sourceHash )
+{
+   BinaryFileHeader header;
+   char name[320];
+   void *binary;
+   GLint length = 0;
+   FILE *file;
+
+   if ( !binaryCacheEnabled ( ) )
+      return;
+
+   glGetProgramiv ( programObject, GL_PROGRAM_BINARY_LENGTH_OES, &length );
+   if ( length <= 0 )
+      return;
+
+   binary = malloc ( length );
+   if ( binary == NULL )
+      return;
+
+   memset ( &header, 0, sizeof(header) );
+   header.magic = BINARY_FILE_MAGIC;
+   header.version = BINARY_FILE_VERSION;
+   header.driverHash = driverHash;
+   header.sourceHash = sourceHash;
+   getProgramBinary ( programObject, length, &header.length, &header.format, binary );
+
+   binaryFileName ( name, sizeof(name), sourceHash );
+   file = header.length > 0 ? fopen ( name, "wb" ) : NULL;
+   if ( file != NULL )
+   {
+      fwrite ( &header, sizeof(header), 1, file );
+      fwrite ( binary, header.length, 1, file );
+      fclose ( file );
+   }
+
+   free ( binary );
+}
+#endif
+
+//
+// Prepend a #define for every feature in mask.  A #version line has to stay
+// first, so the defines go after it.
+//
+static char *buildVariantSource ( const char *src, const char *const *features, GLuint mask )
+{
+   const char *body = src;
+   size_t length = strlen ( src ) + 1;
+   char *result;
+   char *out;
+   int i;
+
+   if ( strncmp ( src, "#version", 8 ) == 0 )
+   {
+      body = strchr ( src, '\n' );
+      body = body != NULL ? body + 1 : src + strlen ( src );
+   }
+
+   for ( i = 0; features != NULL && features[i] != NULL && i < 32; i++ )
+   {
+      if ( mask & ( 1u << i ) )
+         length += strlen ( "#define  1\n" ) + strlen ( features[i] );
+   }
+
+   result = (char *)malloc ( length + 1 );
+   if ( result == NULL )
+      return NULL;
+
+   out = result;
+   memcpy ( out, src, body - src );
+   out += body - src;
+   if ( body != src && out[-1] != '\n' )
+      *out++ = '\n';
+
+   for ( i = 0; features != NULL && features[i] != NULL && i < 32; i++ )
+   {
+      if ( mask & ( 1u << i ) )
+         out += sprintf ( out, "#define %s 1\n", features[i] );
+   }
+
+   strcpy ( out, body );
+   return result;
+}
+
+static void resolveLocations ( ESShaderVariant *variant, const ESShaderSource *source )
+{
+   GLuint program = variant->program->program;
+   const ESReflection *reflection = variant->program->reflection;
+   int i;
+
+   for ( i = 0; i < ES_VARIANT_MAX_LOCATIONS; i++ )
+   {
+      variant->attribLocs[i] = -1;
+      variant->uniformLocs[i] = -1;
+      variant->uniformVars[i] = NULL;
+   }
+
+   for ( i = 0; source->attribs != NULL && source->attribs[i] != NULL && i < ES_VARIANT_MAX_LOCATIONS; i++ )
+   {
+      if ( reflection != NULL )
+      {
+         ESShaderVariable *attrib = esReflectionAttrib ( reflection, source->attribs[i] );
+         variant->attribLocs[i] = attrib != NULL ? attrib->location : -1;
+      }
+      else
+         variant->attribLocs[i] = glGetAttribLocation ( program, source->attribs[i] );
+   }
+
+   for ( i = 0; source->uniforms != NULL && source->uniforms[i] != NULL && i < ES_VARIANT_MAX_LOCATIONS; i++ )
+   {
+      if ( reflection != NULL )
+      {
+         ESShaderVariable *uniform = esReflectionUniform ( reflection, source->uniforms[i] );
+         variant->uniformLocs[i] = uniform != NULL ? uniform->location : -1;
+         variant->uniformVars[i] = uniform;
+      }
+      else
+         variant->uniformLocs[i] = glGetUniformLocation ( program, source->uniforms[i] );
+   }
+
+   variant->resolved = GL_TRUE;
+}
 
 
 //////////////////////////////////////////////////////////////////
@@ -68,7 +400,7 @@ GLuint ESUTIL_API esLoadShader ( GLenum type, const char *shaderSrc )
       
       if ( infoLen > 1 )
       {
-         char* infoLog = malloc (sizeof(char) * infoLen );
+         char* infoLog = (char *)malloc (sizeof(char) * infoLen );
 
          glGetShaderInfoLog ( shader, infoLen, NULL, infoLog );
          esLogMessage ( "Error compiling shader:\n%s\n", infoLog );            
@@ -100,6 +432,15 @@ GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragSha
    GLuint programObject;
    GLint linked;
 
+#ifndef __EMSCRIPTEN__
+   unsigned long long sourceHash = hashString ( hashString ( 14695981039346656037ULL, vertShaderSrc ), fragShaderSrc );
+
+   // A binary saved by an earlier run skips compiling and linking
+   programObject = loadProgramBinary ( sourceHash );
+   if ( programObject != 0 )
+      return programObject;
+#endif
+
    // Load the vertex/fragment shaders
    vertexShader = esLoadShader ( GL_VERTEX_SHADER, vertShaderSrc );
    if ( vertexShader == 0 )
@@ -135,7 +476,7 @@ GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragSha
       
       if ( infoLen > 1 )
       {
-         char* infoLog = malloc (sizeof(char) * infoLen );
+         char* infoLog = (char *)malloc (sizeof(char) * infoLen );
 
          glGetProgramInfoLog ( programObject, infoLen, NULL, infoLog );
          esLogMessage ( "Error linking program:\n%s\n", infoLog );            
@@ -143,7 +484,7 @@ GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragSha
          free ( infoLog );
       }
 
-      glDeleteProgram ( programObject );
+      esStateDeleteProgram ( programObject );
       return 0;
    }
 
@@ -151,5 +492,259 @@ GLuint ESUTIL_API esLoadProgram ( const char *vertShaderSrc, const char *fragSha
    glDeleteShader ( vertexShader );
    glDeleteShader ( fragmentShader );
 
+#ifndef __EMSCRIPTEN__
+   saveProgramBinary ( programObject, sourceHash );
+#endif
+
    return programObject;
+}
+
+//
+///
+/// \brief Keep programs built by esLoadProgram as driver program binaries
+///        Uses GL_OES_get_program_binary; WebGL has no program binaries, so this does nothing
+///        on Emscripten.  Binaries are rebuilt when the GL vendor, renderer or version changes.
+/// \param directory Existing directory for the binaries, or NULL to disable
+//
+void ESUTIL_API esProgramBinaryCachePersist ( const char *directory )
+{
+#ifndef __EMSCRIPTEN__
+   if ( directory == NULL )
+      binaryCachePath[0] = '\0';
+   else
+      snprintf ( binaryCachePath, sizeof(binaryCachePath), "%s", directory );
+#endif
+}
+
+//
+///
+/// \brief Start building a program without waiting for the driver
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \param attribs NULL terminated attribute names bound to locations 0, 1, ..., or NULL
+/// \return The cache entry for these sources, shared with earlier requests for the same sources
+//
+const ESProgram * ESUTIL_API esProgramRequest ( const char *vertShaderSrc, const char *fragShaderSrc,
+                                                const char *const *attribs )
+{
+   unsigned long long hash = 14695981039346656037ULL;
+   ESProgram *entry;
+   GLuint i;
+
+   hash = hashString ( hash, vertShaderSrc );
+   hash = hashString ( hash, fragShaderSrc );
+   for ( i = 0; attribs != NULL && attribs[i] != NULL; i++ )
+      hash = hashString ( hash, attribs[i] );
+
+   for ( i = 0; i < (GLuint)numCachedPrograms; i++ )
+   {
+      if ( programCache[i].hash == hash )
+         return &programCache[i];
+   }
+
+   if ( numCachedPrograms == ES_PROGRAM_CACHE_SIZE )
+   {
+      esLogMessage ( "Program cache full (%d programs)\n", ES_PROGRAM_CACHE_SIZE );
+      return NULL;
+   }
+
+   entry = &programCache[numCachedPrograms++];
+   memset ( entry, 0, sizeof(ESProgram) );
+   entry->hash = hash;
+   entry->status = ES_PROGRAM_PENDING;
+
+   // Issue everything now; no status is queried until esProgramPoll
+   entry->vertexShader = glCreateShader ( GL_VERTEX_SHADER );
+   entry->fragmentShader = glCreateShader ( GL_FRAGMENT_SHADER );
+   entry->program = glCreateProgram ( );
+   if ( entry->vertexShader == 0 || entry->fragmentShader == 0 || entry->program == 0 )
+   {
+      glDeleteShader ( entry->vertexShader );
+      glDeleteShader ( entry->fragmentShader );
+      esStateDeleteProgram ( entry->program );
+      entry->vertexShader = entry->fragmentShader = entry->program = 0;
+      entry->status = ES_PROGRAM_FAILED;
+      return entry;
+   }
+
+   glShaderSource ( entry->vertexShader, 1, &vertShaderSrc, NULL );
+   glShaderSource ( entry->fragmentShader, 1, &fragShaderSrc, NULL );
+   glCompileShader ( entry->vertexShader );
+   glCompileShader ( entry->fragmentShader );
+
+   glAttachShader ( entry->program, entry->vertexShader );
+   glAttachShader ( entry->program, entry->fragmentShader );
+   for ( i = 0; attribs != NULL && attribs[i] != NULL; i++ )
+      glBindAttribLocation ( entry->program, i, attribs[i] );
+   glLinkProgram ( entry->program );
+
+   return entry;
+}
+
+//
+///
+/// \brief Finish programs whose compile and link are done
+///        With KHR_parallel_shader_compile only completed programs are checked, so this never
+///        stalls; call it once per frame.  Without the extension every pending program is
+///        checked, waiting for the driver, but only after all of them have been issued.
+/// \return The number of programs still pending
+//
+int ESUTIL_API esProgramPoll ( void )
+{
+   static int parallelCompile = -1;
+   int pending = 0;
+   int i;
+
+   if ( parallelCompile < 0 )
+      parallelCompile = esHasExtension ( "GL_KHR_parallel_shader_compile" );
+
+   for ( i = 0; i < numCachedPrograms; i++ )
+   {
+      ESProgram *entry = &programCache[i];
+
+      if ( entry->status != ES_PROGRAM_PENDING )
+         continue;
+
+      if ( parallelCompile )
+      {
+         GLint completed = GL_FALSE;
+
+         glGetProgramiv ( entry->program, GL_COMPLETION_STATUS_KHR, &completed );
+         if ( !completed )
+         {
+            pending++;
+            continue;
+         }
+      }
+
+      finishProgram ( entry );
+   }
+
+   return pending;
+}
+
+//
+///
+/// \brief Delete every program in the cache
+//
+void ESUTIL_API esProgramCacheClear ( void )
+{
+   int i;
+
+   for ( i = 0; i < numCachedPrograms; i++ )
+   {
+      glDeleteShader ( programCache[i].vertexShader );
+      glDeleteShader ( programCache[i].fragmentShader );
+      esStateDeleteProgram ( programCache[i].program );
+      if ( programCache[i].reflection != NULL )
+      {
+         esReflectionFree ( programCache[i].reflection );
+         free ( programCache[i].reflection );
+      }
+   }
+   memset ( programCache, 0, sizeof(programCache) );
+   numCachedPrograms = 0;
+
+   // Variants point into the program cache
+   memset ( variantCache, 0, sizeof(variantCache) );
+   numCachedVariants = 0;
+}
+
+//
+///
+/// \brief Set up a shader with optional features.  Nothing is compiled until a variant is requested.
+/// \param source The shader to initialize
+/// \param vertShaderSrc Vertex shader source code
+/// \param fragShaderSrc Fragment shader source code
+/// \param features NULL terminated feature names, at most 32, or NULL
+/// \param attribs NULL terminated attribute names bound to locations 0, 1, ..., or NULL
+/// \param uniforms NULL terminated uniform names resolved for every variant, or NULL
+//
+void ESUTIL_API esShaderSourceInit ( ESShaderSource *source, const char *vertShaderSrc, const char *fragShaderSrc,
+                                     const char *const *features, const char *const *attribs,
+                                     const char *const *uniforms )
+{
+   unsigned long long hash = 14695981039346656037ULL;
+   int i;
+
+   source->vertShaderSrc = vertShaderSrc;
+   source->fragShaderSrc = fragShaderSrc;
+   source->features = features;
+   source->attribs = attribs;
+   source->uniforms = uniforms;
+
+   // Everything that changes the built program goes into the hash
+   hash = hashString ( hash, vertShaderSrc );
+   hash = hashString ( hash, fragShaderSrc );
+   for ( i = 0; features != NULL && features[i] != NULL; i++ )
+      hash = hashString ( hash, features[i] );
+   hash = hashString ( hash, "" );
+   for ( i = 0; attribs != NULL && attribs[i] != NULL; i++ )
+      hash = hashString ( hash, attribs[i] );
+   hash = hashString ( hash, "" );
+   for ( i = 0; uniforms != NULL && uniforms[i] != NULL; i++ )
+      hash = hashString ( hash, uniforms[i] );
+   source->hash = hash;
+}
+
+//
+///
+/// \brief Get the variant of a shader with the features in mask enabled
+///        The first request for a mask builds its sources and starts compiling them with
+///        esProgramRequest; later requests only look up the (source hash, mask) table.
+/// \param source The shader
+/// \param mask Bit i enables source->features[i]
+/// \return The variant, NULL while it is still building or if it failed
+//
+const ESShaderVariant * ESUTIL_API esShaderVariantGet ( const ESShaderSource *source, GLuint mask )
+{
+   unsigned long long key = source->hash ^ ( mask * 0x9E3779B97F4A7C15ULL );
+   int slot = (int)( ( key ^ ( key >> 32 ) ) % ES_VARIANT_CACHE_SIZE );
+   ESShaderVariant *variant;
+
+   // Open addressing with linear probing; entries are only removed all at once
+   for ( ;; )
+   {
+      variant = &variantCache[slot];
+      if ( variant->program == NULL ||
+           ( variant->sourceHash == source->hash && variant->mask == mask ) )
+         break;
+      slot = ( slot + 1 ) % ES_VARIANT_CACHE_SIZE;
+   }
+
+   if ( variant->program == NULL )
+   {
+      char *vertShaderSrc;
+      char *fragShaderSrc;
+
+      // Keep a slot free so probing always ends
+      if ( numCachedVariants == ES_VARIANT_CACHE_SIZE - 1 )
+      {
+         esLogMessage ( "Shader variant cache full (%d variants)\n", ES_VARIANT_CACHE_SIZE - 1 );
+         return NULL;
+      }
+
+      vertShaderSrc = buildVariantSource ( source->vertShaderSrc, source->features, mask );
+      fragShaderSrc = buildVariantSource ( source->fragShaderSrc, source->features, mask );
+      if ( vertShaderSrc != NULL && fragShaderSrc != NULL )
+         variant->program = esProgramRequest ( vertShaderSrc, fragShaderSrc, source->attribs );
+      free ( vertShaderSrc );
+      free ( fragShaderSrc );
+
+      if ( variant->program == NULL )
+         return NULL;
+
+      variant->sourceHash = source->hash;
+      variant->mask = mask;
+      variant->resolved = GL_FALSE;
+      numCachedVariants++;
+   }
+
+   if ( variant->program->status != ES_PROGRAM_READY )
+      return NULL;
+
+   if ( !variant->resolved )
+      resolveLocations ( variant, source );
+
+   return variant;
 }
\ No newline at end of file
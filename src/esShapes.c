@@ -2,9 +2,44 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <limits.h>
 
 #define ES_PI  (3.14159265f)
 
+//
+// The legacy generators write GLushort indices, which address at most
+// 65536 vertices, i.e. 255 slices.  Beyond that they would silently wrap.
+//
+static GLboolean indicesFitUshort ( int numSlices, const char *caller )
+{
+   if ( ( numSlices + 1 ) * ( numSlices + 1 ) <= 65536 )
+      return GL_TRUE;
+
+   esLogMessage ( "%s: %d slices overflow 16-bit indices, use esGenSphereMesh\n", caller, numSlices );
+   return GL_FALSE;
+}
+
+static void genSphereIndices ( int numSlices, GLushort *indexBuf )
+{
+   int i;
+   int j;
+   int numParallels = numSlices;
+
+   for ( i = 0; i < numParallels ; i++ ) 
+   {
+      for ( j = 0; j < numSlices; j++ )
+      {
+         *indexBuf++  = i * ( numSlices + 1 ) + j;
+         *indexBuf++ = ( i + 1 ) * ( numSlices + 1 ) + j;
+         *indexBuf++ = ( i + 1 ) * ( numSlices + 1 ) + ( j + 1 );
+
+         *indexBuf++ = i * ( numSlices + 1 ) + j;
+         *indexBuf++ = ( i + 1 ) * ( numSlices + 1 ) + ( j + 1 );
+         *indexBuf++ = i * ( numSlices + 1 ) + ( j + 1 );
+      }
+   }
+}
+
 int ESUTIL_API esGenSphere ( int numSlices, float radius, GLfloat **vertices, GLfloat **normals, 
                              GLfloat **texCoords, GLushort **indices )
 {
@@ -15,6 +50,19 @@ int ESUTIL_API esGenSphere ( int numSlices, float radius, GLfloat **vertices, GL
    int numIndices = numParallels * numSlices * 6;
    float angleStep = (2.0f * ES_PI) / ((float) numSlices);
 
+   if ( indices != NULL && !indicesFitUshort ( numSlices, "esGenSphere" ) )
+   {
+      // Callers free the arrays unconditionally, so leave them NULL rather than unset
+      if ( vertices != NULL )
+         *vertices = NULL;
+      if ( normals != NULL )
+         *normals = NULL;
+      if ( texCoords != NULL )
+         *texCoords = NULL;
+      *indices = NULL;
+      return 0;
+   }
+
    // Allocate memory for buffers
    if ( vertices != NULL )
       *vertices = (GLfloat *)malloc ( sizeof(GLfloat) * 3 * numVertices );
@@ -61,24 +109,76 @@ int ESUTIL_API esGenSphere ( int numSlices, float radius, GLfloat **vertices, GL
 
    // Generate the indices
    if ( indices != NULL )
+      genSphereIndices ( numSlices, *indices );
+
+   return numIndices;
+}
+
+int ESUTIL_API esGenSphereInterleavedSize ( int numSlices, int *vertexBytes, int *indexBytes )
+{
+   int numVertices = ( numSlices + 1 ) * ( numSlices + 1 );
+   int numIndices = numSlices * numSlices * 6;
+
+   if ( vertexBytes != NULL )
+      *vertexBytes = numVertices * ES_INTERLEAVED_VERTEX_SIZE;
+
+   if ( indexBytes != NULL )
+      *indexBytes = numIndices * sizeof(GLushort);
+
+   return numIndices;
+}
+
+int ESUTIL_API esGenSphereInterleaved ( int numSlices, float radius, GLfloat *vertices, GLushort *indices )
+{
+   int i;
+   int j;
+   int numParallels = numSlices;
+   int stride = numSlices + 1;
+   float angleStep = (2.0f * ES_PI) / ((float) numSlices);
+
+   // esGenSphereMesh generates larger grids here, vertices only
+   if ( indices != NULL && !indicesFitUshort ( numSlices, "esGenSphereInterleaved" ) )
+      return 0;
+
+   if ( vertices != NULL )
    {
-      GLushort *indexBuf = (*indices);
-      for ( i = 0; i < numParallels ; i++ ) 
+      // Both axes step through the same numSlices + 1 angles.  Park that
+      // sin/cos table in the normal slots of row 0, which only needs the
+      // table itself, then fill rows bottom-up so row 0 is overwritten last.
+      for ( j = 0; j < stride; j++ )
       {
-         for ( j = 0; j < numSlices; j++ )
+         vertices[j * 8 + 3] = sinf ( angleStep * (float)j );
+         vertices[j * 8 + 5] = cosf ( angleStep * (float)j );
+      }
+
+      for ( i = numParallels; i >= 0; i-- )
+      {
+         GLfloat sinI = vertices[i * 8 + 3];
+         GLfloat cosI = vertices[i * 8 + 5];
+         GLfloat v = ( 1.0f - (float) i ) / (float) (numParallels - 1 );
+         GLfloat *vert = vertices + i * stride * 8;
+
+         for ( j = 0; j < stride; j++, vert += 8 )
          {
-            *indexBuf++  = i * ( numSlices + 1 ) + j;
-            *indexBuf++ = ( i + 1 ) * ( numSlices + 1 ) + j;
-            *indexBuf++ = ( i + 1 ) * ( numSlices + 1 ) + ( j + 1 );
+            GLfloat sinJ = vertices[j * 8 + 3];
+            GLfloat cosJ = vertices[j * 8 + 5];
 
-            *indexBuf++ = i * ( numSlices + 1 ) + j;
-            *indexBuf++ = ( i + 1 ) * ( numSlices + 1 ) + ( j + 1 );
-            *indexBuf++ = i * ( numSlices + 1 ) + ( j + 1 );
+            vert[3] = sinI * sinJ;
+            vert[4] = cosI;
+            vert[5] = sinI * cosJ;
+            vert[0] = radius * vert[3];
+            vert[1] = radius * vert[4];
+            vert[2] = radius * vert[5];
+            vert[6] = (float) j / (float) numSlices;
+            vert[7] = v;
          }
       }
    }
 
-   return numIndices;
+   if ( indices != NULL )
+      genSphereIndices ( numSlices, indices );
+
+   return numParallels * numSlices * 6;
 }
 
 //
@@ -232,3 +332,329 @@ int ESUTIL_API esGenCube ( float scale, GLfloat **vertices, GLfloat **normals,
 
    return numIndices;
 }
+
+//
+// Largest number of quad rows per sub-mesh whose vertices still fit in
+// 16-bit indices
+//
+static int rowsPerSubMesh ( int numSlices )
+{
+   int rows = 65536 / ( numSlices + 1 ) - 1;
+   return rows < 1 ? 1 : rows;
+}
+
+//
+// Check that every count and byte size esGenSphereMesh computes for this
+// tessellation fits in an int, and that one band of quad rows fits 16-bit
+// indices when the mesh has to be split
+//
+static GLboolean sphereMeshFits ( int numSlices, GLuint flags )
+{
+   long long stride = (long long)numSlices + 1;
+   long long numVertices = stride * stride;
+   long long numIndices = (long long)numSlices * numSlices * 6;
+   long long vertexBytes, indexBytes;
+
+   if ( numSlices < 1 )
+      return GL_FALSE;
+
+   if ( (flags & ES_MESH_UINT_INDICES) || numVertices <= 65536 )
+   {
+      vertexBytes = numVertices * ES_INTERLEAVED_VERTEX_SIZE;
+      indexBytes = numIndices * ( numVertices <= 65536 ? sizeof(GLushort) : sizeof(GLuint) );
+   }
+   else
+   {
+      long long bandRows = 65536 / stride - 1;
+      long long numBands;
+
+      if ( bandRows < 1 )
+         return GL_FALSE;
+      numBands = ( numSlices + bandRows - 1 ) / bandRows;
+      vertexBytes = ( numVertices + ( numBands - 1 ) * stride ) * ES_INTERLEAVED_VERTEX_SIZE;
+      indexBytes = numIndices * sizeof(GLushort);
+   }
+
+   return vertexBytes <= INT_MAX && indexBytes <= INT_MAX;
+}
+
+int ESUTIL_API esGenSphereMesh ( int numSlices, float radius, GLuint flags, ESMesh *mesh )
+{
+   int numVertices;
+   int numIndices;
+   int stride = numSlices + 1;
+   int i;
+
+   memset ( mesh, 0, sizeof(ESMesh) );
+
+   if ( !sphereMeshFits ( numSlices, flags ) )
+   {
+      esLogMessage ( "esGenSphereMesh: %d slices is out of range\n", numSlices );
+      return 0;
+   }
+   numVertices = stride * stride;
+   numIndices = numSlices * numSlices * 6;
+
+   if ( (flags & ES_MESH_UINT_INDICES) || numVertices <= 65536 )
+   {
+      // Single draw, 16 or 32-bit indices
+      mesh->vertices = (GLfloat *)malloc ( numVertices * ES_INTERLEAVED_VERTEX_SIZE );
+      mesh->subMeshes = (ESSubMesh *)malloc ( sizeof(ESSubMesh) );
+      mesh->indexType = numVertices <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+      mesh->indices = malloc ( numIndices * ( mesh->indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort) ) );
+      if ( !mesh->vertices || !mesh->subMeshes || !mesh->indices )
+      {
+         esFreeMesh ( mesh );
+         return 0;
+      }
+
+      esGenSphereInterleaved ( numSlices, radius, mesh->vertices, NULL );
+
+      if ( mesh->indexType == GL_UNSIGNED_SHORT )
+      {
+         genSphereIndices ( numSlices, (GLushort *)mesh->indices );
+      }
+      else
+      {
+         GLuint *indexBuf = (GLuint *)mesh->indices;
+         int j;
+
+         for ( i = 0; i < numSlices; i++ )
+         {
+            for ( j = 0; j < numSlices; j++ )
+            {
+               *indexBuf++ = i * stride + j;
+               *indexBuf++ = ( i + 1 ) * stride + j;
+               *indexBuf++ = ( i + 1 ) * stride + ( j + 1 );
+
+               *indexBuf++ = i * stride + j;
+               *indexBuf++ = ( i + 1 ) * stride + ( j + 1 );
+               *indexBuf++ = i * stride + ( j + 1 );
+            }
+         }
+      }
+
+      mesh->numVertices = numVertices;
+      mesh->numIndices = numIndices;
+      mesh->numSubMeshes = 1;
+      mesh->subMeshes[0].firstVertex = 0;
+      mesh->subMeshes[0].numVertices = numVertices;
+      mesh->subMeshes[0].firstIndex = 0;
+      mesh->subMeshes[0].numIndices = numIndices;
+   }
+   else
+   {
+      // Split into bands of quad rows.  Each band repeats the vertex row it
+      // shares with the next band so its indices stay local and 16-bit.
+      int bandRows = rowsPerSubMesh ( numSlices );
+      int numBands = ( numSlices + bandRows - 1 ) / bandRows;
+      GLfloat *grid = (GLfloat *)malloc ( numVertices * ES_INTERLEAVED_VERTEX_SIZE );
+      GLushort *indexBuf;
+      GLfloat *vertexBuf;
+
+      mesh->numVertices = numVertices + ( numBands - 1 ) * stride;
+      mesh->numIndices = numIndices;
+      mesh->vertices = (GLfloat *)malloc ( mesh->numVertices * ES_INTERLEAVED_VERTEX_SIZE );
+      mesh->indices = malloc ( numIndices * sizeof(GLushort) );
+      mesh->subMeshes = (ESSubMesh *)malloc ( numBands * sizeof(ESSubMesh) );
+      mesh->indexType = GL_UNSIGNED_SHORT;
+      if ( !grid || !mesh->vertices || !mesh->indices || !mesh->subMeshes )
+      {
+         free ( grid );
+         esFreeMesh ( mesh );
+         return 0;
+      }
+
+      esGenSphereInterleaved ( numSlices, radius, grid, NULL );
+
+      vertexBuf = mesh->vertices;
+      indexBuf = (GLushort *)mesh->indices;
+      for ( i = 0; i < numBands; i++ )
+      {
+         ESSubMesh *sub = &mesh->subMeshes[i];
+         int firstRow = i * bandRows;
+         int rows = numSlices - firstRow < bandRows ? numSlices - firstRow : bandRows;
+         int r, j;
+
+         sub->firstVertex = (int)( vertexBuf - mesh->vertices ) / 8;
+         sub->numVertices = ( rows + 1 ) * stride;
+         sub->firstIndex = (int)( indexBuf - (GLushort *)mesh->indices );
+         sub->numIndices = rows * numSlices * 6;
+
+         memcpy ( vertexBuf, grid + firstRow * stride * 8, sub->numVertices * ES_INTERLEAVED_VERTEX_SIZE );
+         vertexBuf += sub->numVertices * 8;
+
+         for ( r = 0; r < rows; r++ )
+         {
+            for ( j = 0; j < numSlices; j++ )
+            {
+               *indexBuf++ = r * stride + j;
+               *indexBuf++ = ( r + 1 ) * stride + j;
+               *indexBuf++ = ( r + 1 ) * stride + ( j + 1 );
+
+               *indexBuf++ = r * stride + j;
+               *indexBuf++ = ( r + 1 ) * stride + ( j + 1 );
+               *indexBuf++ = r * stride + ( j + 1 );
+            }
+         }
+      }
+
+      mesh->numSubMeshes = numBands;
+      free ( grid );
+   }
+
+   if ( (flags & ES_MESH_OPTIMIZE) && !esOptimizeMesh ( mesh, ES_VERTEX_CACHE_SIZE, NULL, NULL ) )
+   {
+      esFreeMesh ( mesh );
+      return 0;
+   }
+
+   return numIndices;
+}
+
+void ESUTIL_API esFreeMesh ( ESMesh *mesh )
+{
+   free ( mesh->vertices );
+   free ( mesh->indices );
+   free ( mesh->subMeshes );
+   memset ( mesh, 0, sizeof(ESMesh) );
+}
+
+void ESUTIL_API esDrawSubMesh ( const ESMesh *mesh, int subMesh, GLint positionLoc, GLint normalLoc, GLint texCoordLoc )
+{
+   int indexSize = mesh->indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+   const ESSubMesh *sub = &mesh->subMeshes[subMesh];
+   char *base = (char *)0 + sub->firstVertex * ES_INTERLEAVED_VERTEX_SIZE;
+
+   // WebGL 1 has no base vertex, so rebase the attribute pointers instead
+   if ( positionLoc >= 0 )
+      esStateVertexAttribPointer ( positionLoc, 3, GL_FLOAT, GL_FALSE, ES_INTERLEAVED_VERTEX_SIZE, base );
+   if ( normalLoc >= 0 )
+      esStateVertexAttribPointer ( normalLoc, 3, GL_FLOAT, GL_FALSE, ES_INTERLEAVED_VERTEX_SIZE, base + 3 * sizeof(GLfloat) );
+   if ( texCoordLoc >= 0 )
+      esStateVertexAttribPointer ( texCoordLoc, 2, GL_FLOAT, GL_FALSE, ES_INTERLEAVED_VERTEX_SIZE, base + 6 * sizeof(GLfloat) );
+
+   glDrawElements ( GL_TRIANGLES, sub->numIndices, mesh->indexType,
+                    (char *)0 + sub->firstIndex * indexSize );
+}
+
+void ESUTIL_API esDrawMesh ( const ESMesh *mesh, GLint positionLoc, GLint normalLoc, GLint texCoordLoc )
+{
+   int i;
+
+   for ( i = 0; i < mesh->numSubMeshes; i++ )
+      esDrawSubMesh ( mesh, i, positionLoc, normalLoc, texCoordLoc );
+}
+
+int ESUTIL_API esGenSphereLodChain ( const int *slices, int numLevels, float radius, ESLodChain *chain )
+{
+   int vertexCount = 0;
+   int indexCount = 0;
+   char *memory;
+   int i;
+
+   memset ( chain, 0, sizeof(ESLodChain) );
+   if ( numLevels < 1 || numLevels > ES_MAX_LOD_LEVELS )
+      return 0;
+
+   for ( i = 0; i < numLevels; i++ )
+   {
+      if ( slices[i] < 1 || ( slices[i] + 1 ) * ( slices[i] + 1 ) > 65536 )
+         return 0;
+      vertexCount += ( slices[i] + 1 ) * ( slices[i] + 1 );
+      indexCount += slices[i] * slices[i] * 6;
+   }
+
+   // One allocation for every level: all vertices, then all indices
+   memory = (char *)malloc ( vertexCount * ES_INTERLEAVED_VERTEX_SIZE + indexCount * sizeof(GLushort) );
+   chain->mesh.subMeshes = (ESSubMesh *)malloc ( numLevels * sizeof(ESSubMesh) );
+   if ( memory == NULL || chain->mesh.subMeshes == NULL )
+   {
+      free ( memory );
+      free ( chain->mesh.subMeshes );
+      chain->mesh.subMeshes = NULL;
+      return 0;
+   }
+
+   chain->mesh.vertices = (GLfloat *)memory;
+   chain->mesh.indices = memory + vertexCount * ES_INTERLEAVED_VERTEX_SIZE;
+   chain->mesh.indexType = GL_UNSIGNED_SHORT;
+   chain->mesh.numVertices = vertexCount;
+   chain->mesh.numIndices = indexCount;
+   chain->mesh.numSubMeshes = numLevels;
+   chain->radius = radius;
+
+   vertexCount = 0;
+   indexCount = 0;
+   for ( i = 0; i < numLevels; i++ )
+   {
+      ESSubMesh *level = &chain->mesh.subMeshes[i];
+
+      level->firstVertex = vertexCount;
+      level->numVertices = ( slices[i] + 1 ) * ( slices[i] + 1 );
+      level->firstIndex = indexCount;
+      level->numIndices = esGenSphereInterleaved ( slices[i], radius, chain->mesh.vertices + vertexCount * 8,
+                                                   (GLushort *)chain->mesh.indices + indexCount );
+      chain->slices[i] = slices[i];
+
+      vertexCount += level->numVertices;
+      indexCount += level->numIndices;
+   }
+
+   return indexCount;
+}
+
+void ESUTIL_API esFreeLodChain ( ESLodChain *chain )
+{
+   // Vertices and indices share one allocation
+   free ( chain->mesh.vertices );
+   free ( chain->mesh.subMeshes );
+   memset ( chain, 0, sizeof(ESLodChain) );
+}
+
+void ESUTIL_API esSelectLodBatch ( const ESLodChain *chain, const GLfloat *distances, int count,
+                                   float fovy, int viewportHeight, float maxEdgePixels, int *levels )
+{
+   // Projected radius in pixels of a sphere at distance d is radius * k / d,
+   // with k matching the focal length esPerspective builds
+   float k = (float)viewportHeight * 0.5f / tanf ( fovy / 360.0f * ES_PI );
+   float circumference = 2.0f * ES_PI * chain->radius * k;
+   float limit[ES_MAX_LOD_LEVELS];
+   int numLevels = chain->mesh.numSubMeshes;
+   int finest = 0;
+   int i, l;
+
+   // A level is good enough while its edges, circumference / slices, stay
+   // under maxEdgePixels, i.e. while d >= circumference / (slices * maxEdgePixels)
+   for ( l = 0; l < numLevels; l++ )
+   {
+      limit[l] = circumference / ( (float)chain->slices[l] * maxEdgePixels );
+      if ( chain->slices[l] > chain->slices[finest] )
+         finest = l;
+   }
+
+   // Levels may come in any order; fall back to the finest one when none is good enough
+   for ( i = 0; i < count; i++ )
+   {
+      int best = finest;
+      int bestSlices = chain->slices[finest];
+
+      for ( l = 0; l < numLevels; l++ )
+      {
+         if ( distances[i] >= limit[l] && chain->slices[l] < bestSlices )
+         {
+            best = l;
+            bestSlices = chain->slices[l];
+         }
+      }
+      levels[i] = best;
+   }
+}
+
+int ESUTIL_API esSelectLod ( const ESLodChain *chain, float distance, float fovy, int viewportHeight, float maxEdgePixels )
+{
+   int level;
+
+   esSelectLodBatch ( chain, &distance, 1, fovy, viewportHeight, maxEdgePixels, &level );
+   return level;
+}
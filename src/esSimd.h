@@ -0,0 +1,86 @@
+// esSimd.h
+//
+//    Private 4-wide float vector helpers shared by the math routines.
+//    Picks wasm simd128 or SSE at compile time; ES_SIMD is left undefined
+//    when neither is available so callers can fall back to scalar code.
+//
+#ifndef ESSIMD_H
+#define ESSIMD_H
+
+#if defined(__wasm_simd128__)
+
+#include <wasm_simd128.h>
+#define ES_SIMD
+#define ES_SIMD_WASM
+
+typedef v128_t esVec4;
+
+#define VEC4_LOAD(p)                    wasm_v128_load(p)
+#define VEC4_STORE(p, v)                wasm_v128_store(p, v)
+#define VEC4_SPLAT(f)                   wasm_f32x4_splat(f)
+#define VEC4_SET(x, y, z, w)            wasm_f32x4_make(x, y, z, w)
+#define VEC4_ADD(a, b)                  wasm_f32x4_add(a, b)
+#define VEC4_SUB(a, b)                  wasm_f32x4_sub(a, b)
+#define VEC4_MUL(a, b)                  wasm_f32x4_mul(a, b)
+#define VEC4_DIV(a, b)                  wasm_f32x4_div(a, b)
+#define VEC4_MIN(a, b)                  wasm_f32x4_min(a, b)
+#define VEC4_MAX(a, b)                  wasm_f32x4_max(a, b)
+#define VEC4_AND(a, b)                  wasm_v128_and(a, b)
+#define VEC4_OR(a, b)                   wasm_v128_or(a, b)
+#define VEC4_CMPGE(a, b)                wasm_f32x4_ge(a, b)
+#define VEC4_CMPLT(a, b)                wasm_f32x4_lt(a, b)
+#define VEC4_MOVEMASK(v)                wasm_i32x4_bitmask(v)
+#define VEC4_X(v)                       wasm_f32x4_extract_lane(v, 0)
+/// (a[x], a[y], b[z], b[w])
+#define VEC4_SHUFFLE(a, b, x, y, z, w)  wasm_i32x4_shuffle(a, b, x, y, (z) + 4, (w) + 4)
+
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+
+#include <xmmintrin.h>
+#define ES_SIMD
+#define ES_SIMD_SSE
+
+typedef __m128 esVec4;
+
+#define VEC4_LOAD(p)                    _mm_loadu_ps(p)
+#define VEC4_STORE(p, v)                _mm_storeu_ps(p, v)
+#define VEC4_SPLAT(f)                   _mm_set1_ps(f)
+#define VEC4_SET(x, y, z, w)            _mm_setr_ps(x, y, z, w)
+#define VEC4_ADD(a, b)                  _mm_add_ps(a, b)
+#define VEC4_SUB(a, b)                  _mm_sub_ps(a, b)
+#define VEC4_MUL(a, b)                  _mm_mul_ps(a, b)
+#define VEC4_DIV(a, b)                  _mm_div_ps(a, b)
+#define VEC4_MIN(a, b)                  _mm_min_ps(a, b)
+#define VEC4_MAX(a, b)                  _mm_max_ps(a, b)
+#define VEC4_AND(a, b)                  _mm_and_ps(a, b)
+#define VEC4_OR(a, b)                   _mm_or_ps(a, b)
+#define VEC4_CMPGE(a, b)                _mm_cmpge_ps(a, b)
+#define VEC4_CMPLT(a, b)                _mm_cmplt_ps(a, b)
+#define VEC4_MOVEMASK(v)                _mm_movemask_ps(v)
+#define VEC4_X(v)                       _mm_cvtss_f32(v)
+/// (a[x], a[y], b[z], b[w])
+#define VEC4_SHUFFLE(a, b, x, y, z, w)  _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+#endif
+
+#ifdef ES_SIMD
+/// (a[x], a[y], a[z], a[w])
+#define VEC4_SWIZZLE(a, x, y, z, w)     VEC4_SHUFFLE(a, a, x, y, z, w)
+/// every lane set to a[i]
+#define VEC4_BROADCAST(a, i)            VEC4_SHUFFLE(a, a, i, i, i, i)
+
+/// transpose the 4x4 matrix held in rows r0..r3 in place
+#define VEC4_TRANSPOSE(r0, r1, r2, r3)                   \
+    do {                                                 \
+        esVec4 t0_ = VEC4_SHUFFLE(r0, r1, 0, 1, 0, 1);   \
+        esVec4 t1_ = VEC4_SHUFFLE(r0, r1, 2, 3, 2, 3);   \
+        esVec4 t2_ = VEC4_SHUFFLE(r2, r3, 0, 1, 0, 1);   \
+        esVec4 t3_ = VEC4_SHUFFLE(r2, r3, 2, 3, 2, 3);   \
+        (r0) = VEC4_SHUFFLE(t0_, t2_, 0, 2, 0, 2);       \
+        (r1) = VEC4_SHUFFLE(t0_, t2_, 1, 3, 1, 3);       \
+        (r2) = VEC4_SHUFFLE(t1_, t3_, 0, 2, 0, 2);       \
+        (r3) = VEC4_SHUFFLE(t1_, t3_, 1, 3, 1, 3);       \
+    } while (0)
+#endif
+
+#endif // ESSIMD_H
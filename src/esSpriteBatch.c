@@ -0,0 +1,214 @@
+// esSpriteBatch.c
+//
+//    Batches textured 2D quads.  Quads accumulate on the CPU until the
+//    texture or program changes, the batch is full or the frame ends, and
+//    each batch is then streamed with esStreamAlloc and drawn with a single
+//    glDrawElements.  All batches share one static index buffer holding the
+//    two triangles of every quad slot; the vertex attribute offsets are
+//    moved to the start of each streamed batch, so indices always start at
+//    quad 0.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static void drawQuads ( ESSpriteBatch *batch, int numQuads, GLsizeiptr offset, GLuint buffer )
+{
+   GLsizei stride = sizeof(ESSpriteVertex);
+
+   esStateBindBuffer ( GL_ARRAY_BUFFER, buffer );
+   if ( batch->positionLoc >= 0 )
+   {
+      esStateVertexAttribPointer ( batch->positionLoc, 2, GL_FLOAT, GL_FALSE, stride, (char *)0 + offset );
+      esStateEnableVertexAttribArray ( batch->positionLoc );
+   }
+   if ( batch->texCoordLoc >= 0 )
+   {
+      esStateVertexAttribPointer ( batch->texCoordLoc, 2, GL_FLOAT, GL_FALSE, stride,
+                                   (char *)0 + offset + 2 * sizeof(GLfloat) );
+      esStateEnableVertexAttribArray ( batch->texCoordLoc );
+   }
+   if ( batch->colorLoc >= 0 )
+   {
+      esStateVertexAttribPointer ( batch->colorLoc, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                                   (char *)0 + offset + 4 * sizeof(GLfloat) );
+      esStateEnableVertexAttribArray ( batch->colorLoc );
+   }
+
+   esStateBindBuffer ( GL_ELEMENT_ARRAY_BUFFER, batch->indexBuffer );
+   glDrawElements ( GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_SHORT, (char *)0 );
+   batch->batches++;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+GLboolean ESUTIL_API esSpriteBatchInit ( ESSpriteBatch *batch, int maxQuads )
+{
+   GLushort *indices;
+   int i;
+
+   memset ( batch, 0, sizeof(ESSpriteBatch) );
+
+   // Four vertices per quad must stay addressable by 16-bit indices
+   if ( maxQuads <= 0 || maxQuads > 65536 / 4 )
+      return GL_FALSE;
+
+   batch->vertices = (ESSpriteVertex *)malloc ( sizeof(ESSpriteVertex) * 4 * maxQuads );
+   indices = (GLushort *)malloc ( sizeof(GLushort) * 6 * maxQuads );
+   if ( batch->vertices == NULL || indices == NULL )
+   {
+      free ( batch->vertices );
+      free ( indices );
+      batch->vertices = NULL;
+      return GL_FALSE;
+   }
+
+   for ( i = 0; i < maxQuads; i++ )
+   {
+      indices[i * 6 + 0] = (GLushort)( i * 4 + 0 );
+      indices[i * 6 + 1] = (GLushort)( i * 4 + 1 );
+      indices[i * 6 + 2] = (GLushort)( i * 4 + 2 );
+      indices[i * 6 + 3] = (GLushort)( i * 4 + 0 );
+      indices[i * 6 + 4] = (GLushort)( i * 4 + 2 );
+      indices[i * 6 + 5] = (GLushort)( i * 4 + 3 );
+   }
+
+   glGenBuffers ( 1, &batch->indexBuffer );
+   esStateBindBuffer ( GL_ELEMENT_ARRAY_BUFFER, batch->indexBuffer );
+   glBufferData ( GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * 6 * maxQuads, indices, GL_STATIC_DRAW );
+   free ( indices );
+
+   batch->maxQuads = maxQuads;
+   batch->positionLoc = -1;
+   batch->texCoordLoc = -1;
+   batch->colorLoc = -1;
+   return GL_TRUE;
+}
+
+void ESUTIL_API esSpriteBatchFree ( ESSpriteBatch *batch )
+{
+   if ( batch->indexBuffer != 0 )
+      esStateDeleteBuffers ( 1, &batch->indexBuffer );
+   free ( batch->vertices );
+   memset ( batch, 0, sizeof(ESSpriteBatch) );
+}
+
+void ESUTIL_API esSpriteBatchBegin ( ESSpriteBatch *batch )
+{
+   batch->numQuads = 0;
+   batch->batches = 0;
+}
+
+void ESUTIL_API esSpriteBatchSetProgram ( ESSpriteBatch *batch, GLuint program, GLint positionLoc,
+                                          GLint texCoordLoc, GLint colorLoc )
+{
+   if ( batch->program == program && batch->positionLoc == positionLoc &&
+        batch->texCoordLoc == texCoordLoc && batch->colorLoc == colorLoc )
+      return;
+
+   esSpriteBatchFlush ( batch );
+   batch->program = program;
+   batch->positionLoc = positionLoc;
+   batch->texCoordLoc = texCoordLoc;
+   batch->colorLoc = colorLoc;
+}
+
+void ESUTIL_API esSpriteBatchDrawQuad ( ESSpriteBatch *batch, GLuint texture, const GLfloat *positions,
+                                        const GLfloat *texCoords, GLuint color )
+{
+   ESSpriteVertex *v;
+   int i;
+
+   if ( texture != batch->texture || batch->numQuads == batch->maxQuads )
+   {
+      esSpriteBatchFlush ( batch );
+      batch->texture = texture;
+   }
+
+   v = &batch->vertices[batch->numQuads * 4];
+   for ( i = 0; i < 4; i++ )
+   {
+      v[i].x = positions[i * 2];
+      v[i].y = positions[i * 2 + 1];
+      v[i].u = texCoords[i * 2];
+      v[i].v = texCoords[i * 2 + 1];
+      v[i].color[0] = (GLubyte)( color >> 24 );
+      v[i].color[1] = (GLubyte)( color >> 16 );
+      v[i].color[2] = (GLubyte)( color >> 8 );
+      v[i].color[3] = (GLubyte)color;
+   }
+   batch->numQuads++;
+}
+
+void ESUTIL_API esSpriteBatchDraw ( ESSpriteBatch *batch, GLuint texture, GLfloat x, GLfloat y, GLfloat width, GLfloat height,
+                                    GLfloat u0, GLfloat v0, GLfloat u1, GLfloat v1, GLuint color )
+{
+   GLfloat positions[8];
+   GLfloat texCoords[8];
+
+   positions[0] = x;          positions[1] = y;           texCoords[0] = u0; texCoords[1] = v0;
+   positions[2] = x + width;  positions[3] = y;           texCoords[2] = u1; texCoords[3] = v0;
+   positions[4] = x + width;  positions[5] = y + height;  texCoords[4] = u1; texCoords[5] = v1;
+   positions[6] = x;          positions[7] = y + height;  texCoords[6] = u0; texCoords[7] = v1;
+
+   esSpriteBatchDrawQuad ( batch, texture, positions, texCoords, color );
+}
+
+void ESUTIL_API esSpriteBatchFlush ( ESSpriteBatch *batch )
+{
+   const ESSpriteVertex *vertices = batch->vertices;
+   int remaining = batch->numQuads;
+   int chunk = remaining;
+
+   if ( remaining == 0 )
+      return;
+
+   esStateUseProgram ( batch->program );
+   esStateBindTexture ( GL_TEXTURE_2D, batch->texture );
+
+   // Stream the quads, in smaller draws if they do not fit a stream buffer
+   while ( remaining > 0 )
+   {
+      ESStreamAlloc alloc;
+
+      if ( chunk > remaining )
+         chunk = remaining;
+      alloc = esStreamAlloc ( (GLsizeiptr)chunk * 4 * sizeof(ESSpriteVertex) );
+      if ( alloc.ptr == NULL )
+      {
+         if ( chunk == 1 )
+            break;
+         chunk /= 2;
+         continue;
+      }
+
+      memcpy ( alloc.ptr, vertices, chunk * 4 * sizeof(ESSpriteVertex) );
+      esStreamFlush ( );
+      drawQuads ( batch, chunk, alloc.offset, alloc.buffer );
+
+      vertices += chunk * 4;
+      remaining -= chunk;
+   }
+
+   batch->numQuads = 0;
+}
+
+int ESUTIL_API esSpriteBatchEnd ( ESSpriteBatch *batch )
+{
+   esSpriteBatchFlush ( batch );
+   return batch->batches;
+}
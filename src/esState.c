@@ -0,0 +1,379 @@
+// esState.c
+//
+//    Shadow copy of the GL state that changes most often while drawing:
+//    program, buffer and texture bindings, vertex attribute arrays, blend and depth
+//    state and the viewport.  Each esState* call compares against the
+//    shadow copy and only reaches GL when the value actually changes, which
+//    matters under Emscripten where every GL call crosses into JavaScript.
+//
+//    GL state changed behind the cache's back must be followed by
+//    esStateInvalidate.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <string.h>
+
+#define UNKNOWN  0xFFFFFFFFu
+
+typedef struct
+{
+   GLboolean    enabled;
+   GLuint       buffer;
+   GLint        size;
+   GLenum       type;
+   GLboolean    normalized;
+   GLsizei      stride;
+   const void  *pointer;
+} AttribState;
+
+typedef struct
+{
+   GLboolean    initialized;
+   GLuint       program;
+   GLuint       arrayBuffer;
+   GLuint       elementArrayBuffer;
+   AttribState  attribs[ES_STATE_MAX_ATTRIBS];
+   GLenum       activeTexture;
+   GLuint       textures[ES_STATE_MAX_TEXTURE_UNITS][2];
+   GLboolean    caps[9];
+   GLenum       blendSrc, blendDst;
+   GLenum       blendEquation;
+   GLenum       depthFunc;
+   GLboolean    depthMask;
+   GLint        viewport[4];
+   ESStateStats stats;
+} StateCache;
+
+static StateCache state;
+
+// Capabilities tracked by esStateEnable/esStateDisable, others go straight to GL
+static const GLenum trackedCaps[9] =
+{
+   GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_DITHER, GL_POLYGON_OFFSET_FILL,
+   GL_SAMPLE_ALPHA_TO_COVERAGE, GL_SAMPLE_COVERAGE, GL_SCISSOR_TEST, GL_STENCIL_TEST
+};
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static StateCache *getState ( void )
+{
+   if ( !state.initialized )
+      esStateInvalidate ( );
+   return &state;
+}
+
+static int capIndex ( GLenum cap )
+{
+   int i;
+
+   for ( i = 0; i < 9; i++ )
+   {
+      if ( trackedCaps[i] == cap )
+         return i;
+   }
+   return -1;
+}
+
+static void setCap ( GLenum cap, GLboolean enabled )
+{
+   StateCache *s = getState ( );
+   int i = capIndex ( cap );
+
+   if ( i >= 0 && s->caps[i] == enabled )
+   {
+      s->stats.skipped++;
+      return;
+   }
+
+   if ( enabled )
+      glEnable ( cap );
+   else
+      glDisable ( cap );
+   if ( i >= 0 )
+      s->caps[i] = enabled;
+   s->stats.issued++;
+}
+
+static void setAttribArray ( GLuint index, GLboolean enabled )
+{
+   StateCache *s = getState ( );
+
+   if ( index < ES_STATE_MAX_ATTRIBS && s->attribs[index].enabled == enabled )
+   {
+      s->stats.skipped++;
+      return;
+   }
+
+   if ( enabled )
+      glEnableVertexAttribArray ( index );
+   else
+      glDisableVertexAttribArray ( index );
+   if ( index < ES_STATE_MAX_ATTRIBS )
+      s->attribs[index].enabled = enabled;
+   s->stats.issued++;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+void ESUTIL_API esStateInvalidate ( void )
+{
+   ESStateStats stats = state.stats;
+   int i;
+
+   memset ( &state, 0xFF, sizeof(StateCache) );
+   for ( i = 0; i < 4; i++ )
+      state.viewport[i] = -1;
+   state.stats = stats;
+   state.initialized = GL_TRUE;
+}
+
+void ESUTIL_API esStateGetStats ( ESStateStats *stats, GLboolean reset )
+{
+   StateCache *s = getState ( );
+
+   if ( stats != NULL )
+      *stats = s->stats;
+   if ( reset )
+      memset ( &s->stats, 0, sizeof(ESStateStats) );
+}
+
+void ESUTIL_API esStateUseProgram ( GLuint program )
+{
+   StateCache *s = getState ( );
+
+   if ( s->program == program )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glUseProgram ( program );
+   s->program = program;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateBindBuffer ( GLenum target, GLuint buffer )
+{
+   StateCache *s = getState ( );
+   GLuint *bound = target == GL_ELEMENT_ARRAY_BUFFER ? &s->elementArrayBuffer : &s->arrayBuffer;
+
+   if ( *bound == buffer )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glBindBuffer ( target, buffer );
+   *bound = buffer;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateDeleteProgram ( GLuint program )
+{
+   StateCache *s = getState ( );
+
+   glDeleteProgram ( program );
+   s->stats.issued++;
+
+   // A current program stays in use until replaced, but its name may be
+   // reused once it is, so the next esStateUseProgram must reach GL
+   if ( program != 0 && s->program == program )
+      s->program = UNKNOWN;
+}
+
+void ESUTIL_API esStateDeleteBuffers ( GLsizei n, const GLuint *buffers )
+{
+   StateCache *s = getState ( );
+   int i, a;
+
+   glDeleteBuffers ( n, buffers );
+   s->stats.issued++;
+
+   // GL unbinds deleted buffers; attribute arrays keep pointing at them
+   for ( i = 0; i < n; i++ )
+   {
+      if ( buffers[i] == 0 )
+         continue;
+      if ( s->arrayBuffer == buffers[i] )
+         s->arrayBuffer = 0;
+      if ( s->elementArrayBuffer == buffers[i] )
+         s->elementArrayBuffer = 0;
+      for ( a = 0; a < ES_STATE_MAX_ATTRIBS; a++ )
+      {
+         // The name may be reused by glGenBuffers, so forget the pointer
+         if ( s->attribs[a].buffer == buffers[i] )
+            s->attribs[a].buffer = UNKNOWN;
+      }
+   }
+}
+
+void ESUTIL_API esStateActiveTexture ( GLenum texture )
+{
+   StateCache *s = getState ( );
+
+   if ( s->activeTexture == texture )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glActiveTexture ( texture );
+   s->activeTexture = texture;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateBindTexture ( GLenum target, GLuint texture )
+{
+   StateCache *s = getState ( );
+   GLuint unit = s->activeTexture - GL_TEXTURE0;
+   GLuint *bound = NULL;
+
+   if ( unit < ES_STATE_MAX_TEXTURE_UNITS )
+      bound = &s->textures[unit][target == GL_TEXTURE_CUBE_MAP ? 1 : 0];
+
+   if ( bound != NULL && *bound == texture )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glBindTexture ( target, texture );
+   if ( bound != NULL )
+      *bound = texture;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateVertexAttribPointer ( GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                             GLsizei stride, const void *pointer )
+{
+   StateCache *s = getState ( );
+   AttribState *attrib;
+
+   if ( index >= ES_STATE_MAX_ATTRIBS )
+   {
+      glVertexAttribPointer ( index, size, type, normalized, stride, pointer );
+      s->stats.issued++;
+      return;
+   }
+
+   // The pointer is captured relative to the GL_ARRAY_BUFFER bound now
+   attrib = &s->attribs[index];
+   if ( attrib->buffer == s->arrayBuffer && s->arrayBuffer != UNKNOWN && attrib->size == size &&
+        attrib->type == type && attrib->normalized == normalized && attrib->stride == stride &&
+        attrib->pointer == pointer )
+   {
+      s->stats.skipped++;
+      return;
+   }
+
+   glVertexAttribPointer ( index, size, type, normalized, stride, pointer );
+   attrib->buffer = s->arrayBuffer;
+   attrib->size = size;
+   attrib->type = type;
+   attrib->normalized = normalized;
+   attrib->stride = stride;
+   attrib->pointer = pointer;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateEnableVertexAttribArray ( GLuint index )
+{
+   setAttribArray ( index, GL_TRUE );
+}
+
+void ESUTIL_API esStateDisableVertexAttribArray ( GLuint index )
+{
+   setAttribArray ( index, GL_FALSE );
+}
+
+void ESUTIL_API esStateEnable ( GLenum cap )
+{
+   setCap ( cap, GL_TRUE );
+}
+
+void ESUTIL_API esStateDisable ( GLenum cap )
+{
+   setCap ( cap, GL_FALSE );
+}
+
+void ESUTIL_API esStateBlendFunc ( GLenum sfactor, GLenum dfactor )
+{
+   StateCache *s = getState ( );
+
+   if ( s->blendSrc == sfactor && s->blendDst == dfactor )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glBlendFunc ( sfactor, dfactor );
+   s->blendSrc = sfactor;
+   s->blendDst = dfactor;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateBlendEquation ( GLenum mode )
+{
+   StateCache *s = getState ( );
+
+   if ( s->blendEquation == mode )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glBlendEquation ( mode );
+   s->blendEquation = mode;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateDepthFunc ( GLenum func )
+{
+   StateCache *s = getState ( );
+
+   if ( s->depthFunc == func )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glDepthFunc ( func );
+   s->depthFunc = func;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateDepthMask ( GLboolean flag )
+{
+   StateCache *s = getState ( );
+
+   flag = flag ? GL_TRUE : GL_FALSE;
+   if ( s->depthMask == flag )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glDepthMask ( flag );
+   s->depthMask = flag;
+   s->stats.issued++;
+}
+
+void ESUTIL_API esStateViewport ( GLint x, GLint y, GLsizei width, GLsizei height )
+{
+   StateCache *s = getState ( );
+
+   if ( s->viewport[0] == x && s->viewport[1] == y && s->viewport[2] == width && s->viewport[3] == height )
+   {
+      s->stats.skipped++;
+      return;
+   }
+   glViewport ( x, y, width, height );
+   s->viewport[0] = x;
+   s->viewport[1] = y;
+   s->viewport[2] = width;
+   s->viewport[3] = height;
+   s->stats.issued++;
+}
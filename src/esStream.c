@@ -0,0 +1,125 @@
+// esStream.c
+//
+//    Streaming of per-frame geometry through a small ring of preallocated
+//    GL_ARRAY_BUFFERs.  Allocations are carved linearly out of the current
+//    buffer and written to a CPU-side shadow copy, which esStreamFlush
+//    uploads with one glBufferSubData.  When a buffer is full the ring moves
+//    on to the next one and orphans it with glBufferData ( NULL ), so the
+//    driver can hand out fresh storage instead of waiting for draws that
+//    still read the old contents.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+   GLuint      buffers[ES_STREAM_BUFFERS];
+   int         current;
+   GLsizeiptr  capacity;
+   GLsizeiptr  offset;
+   GLsizeiptr  flushed;
+   char       *shadow;
+} StreamRing;
+
+static StreamRing ring;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+//
+// Move to the next buffer of the ring and orphan its old storage
+//
+static void nextBuffer ( void )
+{
+   esStreamFlush ( );
+
+   ring.current = ( ring.current + 1 ) % ES_STREAM_BUFFERS;
+   ring.offset = 0;
+   ring.flushed = 0;
+
+   esStateBindBuffer ( GL_ARRAY_BUFFER, ring.buffers[ring.current] );
+   glBufferData ( GL_ARRAY_BUFFER, ring.capacity, NULL, GL_STREAM_DRAW );
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+GLboolean ESUTIL_API esStreamInit ( GLsizeiptr capacity )
+{
+   int i;
+
+   esStreamShutdown ( );
+
+   ring.shadow = (char *)malloc ( capacity );
+   if ( ring.shadow == NULL )
+      return GL_FALSE;
+
+   glGenBuffers ( ES_STREAM_BUFFERS, ring.buffers );
+   for ( i = 0; i < ES_STREAM_BUFFERS; i++ )
+   {
+      esStateBindBuffer ( GL_ARRAY_BUFFER, ring.buffers[i] );
+      glBufferData ( GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW );
+   }
+
+   ring.capacity = capacity;
+   ring.current = 0;
+   ring.offset = 0;
+   ring.flushed = 0;
+   return GL_TRUE;
+}
+
+void ESUTIL_API esStreamShutdown ( void )
+{
+   if ( ring.shadow != NULL )
+      esStateDeleteBuffers ( ES_STREAM_BUFFERS, ring.buffers );
+
+   free ( ring.shadow );
+   memset ( &ring, 0, sizeof(StreamRing) );
+}
+
+ESStreamAlloc ESUTIL_API esStreamAlloc ( GLsizeiptr bytes )
+{
+   ESStreamAlloc alloc;
+   GLsizeiptr start = ( ring.offset + ES_STREAM_ALIGNMENT - 1 ) & ~(GLsizeiptr)( ES_STREAM_ALIGNMENT - 1 );
+
+   memset ( &alloc, 0, sizeof(ESStreamAlloc) );
+   if ( ring.shadow == NULL || bytes <= 0 || bytes > ring.capacity )
+      return alloc;
+
+   if ( start + bytes > ring.capacity )
+   {
+      nextBuffer ( );
+      start = 0;
+   }
+
+   alloc.ptr = ring.shadow + start;
+   alloc.buffer = ring.buffers[ring.current];
+   alloc.offset = start;
+
+   // Padding between allocations is uploaded as part of the flushed range
+   if ( ring.offset == ring.flushed )
+      ring.flushed = start;
+   ring.offset = start + bytes;
+   return alloc;
+}
+
+void ESUTIL_API esStreamFlush ( void )
+{
+   if ( ring.shadow == NULL || ring.offset == ring.flushed )
+      return;
+
+   esStateBindBuffer ( GL_ARRAY_BUFFER, ring.buffers[ring.current] );
+   glBufferSubData ( GL_ARRAY_BUFFER, ring.flushed, ring.offset - ring.flushed, ring.shadow + ring.flushed );
+   ring.flushed = ring.offset;
+}
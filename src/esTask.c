@@ -0,0 +1,137 @@
+// esTask.c
+//
+//    Worker pool for data-parallel jobs such as esSceneUpdate and
+//    esCommandBufferRecordParallel.  Workers are started on first use and
+//    then kept alive, waiting on a condition variable between jobs, so no
+//    thread is created or joined per frame.  Under Emscripten the workers
+//    come from the PTHREAD_POOL_SIZE pool set in the Makefile.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+//
+// Worker t runs task t of the current job; task 0 runs on the caller.
+//
+static pthread_mutex_t poolRunLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  poolStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  poolDone = PTHREAD_COND_INITIALIZER;
+static int             poolWorkers = 1;
+static unsigned int    poolGeneration;
+static unsigned int    poolBorn[ES_MAX_THREADS];
+static int             poolTasks;
+static int             poolPending;
+static void          (ESCALLBACK *poolFunc)(int, void *);
+static void           *poolData;
+
+// Set while this thread runs a task, so nested esTaskRun calls run inline
+static __thread int    inTask;
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static void *poolThread(void *arg)
+{
+    int          task = (int)(size_t)arg;
+    unsigned int seen;
+
+    inTask = 1;
+
+    pthread_mutex_lock(&poolLock);
+    seen = poolBorn[task];
+    for (;;)
+    {
+        while ( poolGeneration == seen )
+            pthread_cond_wait(&poolStart, &poolLock);
+        seen = poolGeneration;
+
+        if ( task < poolTasks )
+        {
+            void (ESCALLBACK *func)(int, void *) = poolFunc;
+            void *data = poolData;
+
+            pthread_mutex_unlock(&poolLock);
+            func(task, data);
+            pthread_mutex_lock(&poolLock);
+
+            if ( --poolPending == 0 )
+                pthread_cond_signal(&poolDone);
+        }
+    }
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+void ESUTIL_API esTaskRun(int numTasks, void (ESCALLBACK *func)(int task, void *data), void *data)
+{
+    int workers;
+    int t;
+
+    if ( numTasks > ES_MAX_THREADS )
+        numTasks = ES_MAX_THREADS;
+
+    // Called from inside a task: the workers are busy with the outer job,
+    // so run every task here rather than wait for them
+    if ( numTasks <= 1 || inTask )
+    {
+        for (t = 0; t < numTasks; t++)
+            func(t, data);
+        return;
+    }
+
+    // One job at a time; the workers only know about a single job
+    pthread_mutex_lock(&poolRunLock);
+    pthread_mutex_lock(&poolLock);
+
+    // Start missing workers once; they live for the rest of the program
+    while ( poolWorkers < numTasks )
+    {
+        pthread_t      thread;
+        pthread_attr_t attr;
+        int            result;
+
+        poolBorn[poolWorkers] = poolGeneration;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        result = pthread_create(&thread, &attr, poolThread, (void *)(size_t)poolWorkers);
+        pthread_attr_destroy(&attr);
+        if ( result != 0 )
+            break;
+        poolWorkers++;
+    }
+
+    workers = poolWorkers < numTasks ? poolWorkers : numTasks;
+    poolTasks = workers;
+    poolPending = workers - 1;
+    poolFunc = func;
+    poolData = data;
+    poolGeneration++;
+    pthread_cond_broadcast(&poolStart);
+    pthread_mutex_unlock(&poolLock);
+
+    // The calling thread takes task 0, and any task no worker could take
+    inTask = 1;
+    func(0, data);
+    for (t = workers; t < numTasks; t++)
+        func(t, data);
+    inTask = 0;
+
+    pthread_mutex_lock(&poolLock);
+    while ( poolPending > 0 )
+        pthread_cond_wait(&poolDone, &poolLock);
+    pthread_mutex_unlock(&poolLock);
+    pthread_mutex_unlock(&poolRunLock);
+}
@@ -21,6 +21,7 @@
 #include "esUtil.h"
 #include <math.h>
 #include <string.h>
+#include "esSimd.h"
 
 #define PI 3.1415926535897932384626433832795f
 
@@ -169,35 +170,61 @@ esOrtho(ESMatrix *result, float left, float right, float bottom, float top, floa
 }
 
 
+//
+// Multiply kernel shared by esMatrixMultiply and esMatrixMultiplyBatch.
+// Row i of the result is the sum of the rows of b weighted by row i of a,
+// so each row is four broadcast multiply-adds.  All rows are computed
+// before anything is stored, which keeps result == srcA / srcB safe.
+//
+static void
+matrixMultiply4x4(GLfloat *out, const GLfloat *a, const GLfloat *b)
+{
+#ifdef ES_SIMD
+    esVec4 b0 = VEC4_LOAD(b + 0);
+    esVec4 b1 = VEC4_LOAD(b + 4);
+    esVec4 b2 = VEC4_LOAD(b + 8);
+    esVec4 b3 = VEC4_LOAD(b + 12);
+    esVec4 r[4];
+    int    i;
+
+    for (i = 0; i < 4; i++)
+    {
+        esVec4 row = VEC4_MUL(VEC4_SPLAT(a[i*4 + 0]), b0);
+        row = VEC4_ADD(row, VEC4_MUL(VEC4_SPLAT(a[i*4 + 1]), b1));
+        row = VEC4_ADD(row, VEC4_MUL(VEC4_SPLAT(a[i*4 + 2]), b2));
+        row = VEC4_ADD(row, VEC4_MUL(VEC4_SPLAT(a[i*4 + 3]), b3));
+        r[i] = row;
+    }
+    for (i = 0; i < 4; i++)
+        VEC4_STORE(out + i*4, r[i]);
+#else
+    GLfloat tmp[16];
+    int     i;
+
+    for (i = 0; i < 4; i++)
+    {
+        tmp[i*4 + 0] = a[i*4 + 0] * b[0] + a[i*4 + 1] * b[4] + a[i*4 + 2] * b[8]  + a[i*4 + 3] * b[12];
+        tmp[i*4 + 1] = a[i*4 + 0] * b[1] + a[i*4 + 1] * b[5] + a[i*4 + 2] * b[9]  + a[i*4 + 3] * b[13];
+        tmp[i*4 + 2] = a[i*4 + 0] * b[2] + a[i*4 + 1] * b[6] + a[i*4 + 2] * b[10] + a[i*4 + 3] * b[14];
+        tmp[i*4 + 3] = a[i*4 + 0] * b[3] + a[i*4 + 1] * b[7] + a[i*4 + 2] * b[11] + a[i*4 + 3] * b[15];
+    }
+    memcpy(out, tmp, sizeof(tmp));
+#endif
+}
+
 void ESUTIL_API
 esMatrixMultiply(ESMatrix *result, ESMatrix *srcA, ESMatrix *srcB)
 {
-    ESMatrix    tmp;
-    int         i;
-
-	for (i=0; i<4; i++)
-	{
-		tmp.m[i][0] =	(srcA->m[i][0] * srcB->m[0][0]) +
-						(srcA->m[i][1] * srcB->m[1][0]) +
-						(srcA->m[i][2] * srcB->m[2][0]) +
-						(srcA->m[i][3] * srcB->m[3][0]) ;
-
-		tmp.m[i][1] =	(srcA->m[i][0] * srcB->m[0][1]) + 
-						(srcA->m[i][1] * srcB->m[1][1]) +
-						(srcA->m[i][2] * srcB->m[2][1]) +
-						(srcA->m[i][3] * srcB->m[3][1]) ;
+    matrixMultiply4x4(&result->m[0][0], &srcA->m[0][0], &srcB->m[0][0]);
+}
 
-		tmp.m[i][2] =	(srcA->m[i][0] * srcB->m[0][2]) + 
-						(srcA->m[i][1] * srcB->m[1][2]) +
-						(srcA->m[i][2] * srcB->m[2][2]) +
-						(srcA->m[i][3] * srcB->m[3][2]) ;
+void ESUTIL_API
+esMatrixMultiplyBatch(ESMatrix *out, const ESMatrix *a, const ESMatrix *b, int count)
+{
+    int i;
 
-		tmp.m[i][3] =	(srcA->m[i][0] * srcB->m[0][3]) + 
-						(srcA->m[i][1] * srcB->m[1][3]) +
-						(srcA->m[i][2] * srcB->m[2][3]) +
-						(srcA->m[i][3] * srcB->m[3][3]) ;
-	}
-    memcpy(result, &tmp, sizeof(ESMatrix));
+    for (i = 0; i < count; i++)
+        matrixMultiply4x4(&out[i].m[0][0], &a[i].m[0][0], &b[i].m[0][0]);
 }
 
 
@@ -211,3 +238,442 @@ esMatrixLoadIdentity(ESMatrix *result)
     result->m[3][3] = 1.0f;
 }
 
+
+#ifdef ES_SIMD
+//
+// 2x2 helpers for the block-wise 4x4 inverse.  A 2x2 matrix is packed
+// row-major into one vector as (m00, m01, m10, m11), and A# denotes the
+// adjugate of A.
+//
+
+// A * B
+static esVec4 mat2Mul(esVec4 a, esVec4 b)
+{
+    return VEC4_ADD(VEC4_MUL(a, VEC4_SWIZZLE(b, 0, 3, 0, 3)),
+                    VEC4_MUL(VEC4_SWIZZLE(a, 1, 0, 3, 2), VEC4_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// A# * B
+static esVec4 mat2AdjMul(esVec4 a, esVec4 b)
+{
+    return VEC4_SUB(VEC4_MUL(VEC4_SWIZZLE(a, 3, 3, 0, 0), b),
+                    VEC4_MUL(VEC4_SWIZZLE(a, 1, 1, 2, 2), VEC4_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// A * B#
+static esVec4 mat2MulAdj(esVec4 a, esVec4 b)
+{
+    return VEC4_SUB(VEC4_MUL(a, VEC4_SWIZZLE(b, 3, 0, 3, 0)),
+                    VEC4_MUL(VEC4_SWIZZLE(a, 1, 0, 3, 2), VEC4_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// (a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0) for w == 0 inputs
+static esVec4 vec3Cross(esVec4 a, esVec4 b)
+{
+    esVec4 r = VEC4_SUB(VEC4_MUL(a, VEC4_SWIZZLE(b, 1, 2, 0, 3)),
+                        VEC4_MUL(VEC4_SWIZZLE(a, 1, 2, 0, 3), b));
+    return VEC4_SWIZZLE(r, 1, 2, 0, 3);
+}
+#endif
+
+//
+// Invert the 4x4 matrix at in into out using the 2x2 block method.
+// Returns GL_FALSE and leaves out untouched if the matrix is singular.
+//
+static GLboolean
+matrixInverse4x4(GLfloat *out, const GLfloat *in)
+{
+#ifdef ES_SIMD
+    esVec4 r0 = VEC4_LOAD(in + 0);
+    esVec4 r1 = VEC4_LOAD(in + 4);
+    esVec4 r2 = VEC4_LOAD(in + 8);
+    esVec4 r3 = VEC4_LOAD(in + 12);
+
+    // Sub matrices M = | A B |
+    //                  | C D |
+    esVec4 A = VEC4_SHUFFLE(r0, r1, 0, 1, 0, 1);
+    esVec4 B = VEC4_SHUFFLE(r0, r1, 2, 3, 2, 3);
+    esVec4 C = VEC4_SHUFFLE(r2, r3, 0, 1, 0, 1);
+    esVec4 D = VEC4_SHUFFLE(r2, r3, 2, 3, 2, 3);
+
+    // (|A|, |B|, |C|, |D|)
+    esVec4 detSub = VEC4_SUB(VEC4_MUL(VEC4_SHUFFLE(r0, r2, 0, 2, 0, 2), VEC4_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+                             VEC4_MUL(VEC4_SHUFFLE(r0, r2, 1, 3, 1, 3), VEC4_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+    esVec4 detA = VEC4_BROADCAST(detSub, 0);
+    esVec4 detB = VEC4_BROADCAST(detSub, 1);
+    esVec4 detC = VEC4_BROADCAST(detSub, 2);
+    esVec4 detD = VEC4_BROADCAST(detSub, 3);
+
+    esVec4 D_C = mat2AdjMul(D, C);
+    esVec4 A_B = mat2AdjMul(A, B);
+
+    // Adjugates of the blocks of the inverse
+    esVec4 X_ = VEC4_SUB(VEC4_MUL(detD, A), mat2Mul(B, D_C));
+    esVec4 W_ = VEC4_SUB(VEC4_MUL(detA, D), mat2Mul(C, A_B));
+    esVec4 Y_ = VEC4_SUB(VEC4_MUL(detB, C), mat2MulAdj(D, A_B));
+    esVec4 Z_ = VEC4_SUB(VEC4_MUL(detC, B), mat2MulAdj(A, D_C));
+
+    // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+    esVec4 tr = VEC4_MUL(A_B, VEC4_SWIZZLE(D_C, 0, 2, 1, 3));
+    esVec4 detM;
+
+    tr = VEC4_ADD(tr, VEC4_SWIZZLE(tr, 1, 0, 3, 2));
+    tr = VEC4_ADD(tr, VEC4_SWIZZLE(tr, 2, 3, 0, 1));
+    detM = VEC4_SUB(VEC4_ADD(VEC4_MUL(detA, detD), VEC4_MUL(detB, detC)), tr);
+
+    if ( VEC4_X(detM) == 0.0f )
+        return GL_FALSE;
+
+    detM = VEC4_DIV(VEC4_SET(1.0f, -1.0f, -1.0f, 1.0f), detM);
+    X_ = VEC4_MUL(X_, detM);
+    Y_ = VEC4_MUL(Y_, detM);
+    Z_ = VEC4_MUL(Z_, detM);
+    W_ = VEC4_MUL(W_, detM);
+
+    // Apply the final adjugate swizzle while interleaving back into rows
+    VEC4_STORE(out + 0,  VEC4_SHUFFLE(X_, Y_, 3, 1, 3, 1));
+    VEC4_STORE(out + 4,  VEC4_SHUFFLE(X_, Y_, 2, 0, 2, 0));
+    VEC4_STORE(out + 8,  VEC4_SHUFFLE(Z_, W_, 3, 1, 3, 1));
+    VEC4_STORE(out + 12, VEC4_SHUFFLE(Z_, W_, 2, 0, 2, 0));
+    return GL_TRUE;
+#else
+    GLfloat inv[16];
+    GLfloat det;
+    int     i;
+
+    inv[0]  =  in[5]*in[10]*in[15] - in[5]*in[11]*in[14] - in[9]*in[6]*in[15] + in[9]*in[7]*in[14] + in[13]*in[6]*in[11] - in[13]*in[7]*in[10];
+    inv[4]  = -in[4]*in[10]*in[15] + in[4]*in[11]*in[14] + in[8]*in[6]*in[15] - in[8]*in[7]*in[14] - in[12]*in[6]*in[11] + in[12]*in[7]*in[10];
+    inv[8]  =  in[4]*in[9]*in[15]  - in[4]*in[11]*in[13] - in[8]*in[5]*in[15] + in[8]*in[7]*in[13] + in[12]*in[5]*in[11] - in[12]*in[7]*in[9];
+    inv[12] = -in[4]*in[9]*in[14]  + in[4]*in[10]*in[13] + in[8]*in[5]*in[14] - in[8]*in[6]*in[13] - in[12]*in[5]*in[10] + in[12]*in[6]*in[9];
+    inv[1]  = -in[1]*in[10]*in[15] + in[1]*in[11]*in[14] + in[9]*in[2]*in[15] - in[9]*in[3]*in[14] - in[13]*in[2]*in[11] + in[13]*in[3]*in[10];
+    inv[5]  =  in[0]*in[10]*in[15] - in[0]*in[11]*in[14] - in[8]*in[2]*in[15] + in[8]*in[3]*in[14] + in[12]*in[2]*in[11] - in[12]*in[3]*in[10];
+    inv[9]  = -in[0]*in[9]*in[15]  + in[0]*in[11]*in[13] + in[8]*in[1]*in[15] - in[8]*in[3]*in[13] - in[12]*in[1]*in[11] + in[12]*in[3]*in[9];
+    inv[13] =  in[0]*in[9]*in[14]  - in[0]*in[10]*in[13] - in[8]*in[1]*in[14] + in[8]*in[2]*in[13] + in[12]*in[1]*in[10] - in[12]*in[2]*in[9];
+    inv[2]  =  in[1]*in[6]*in[15]  - in[1]*in[7]*in[14]  - in[5]*in[2]*in[15] + in[5]*in[3]*in[14] + in[13]*in[2]*in[7]  - in[13]*in[3]*in[6];
+    inv[6]  = -in[0]*in[6]*in[15]  + in[0]*in[7]*in[14]  + in[4]*in[2]*in[15] - in[4]*in[3]*in[14] - in[12]*in[2]*in[7]  + in[12]*in[3]*in[6];
+    inv[10] =  in[0]*in[5]*in[15]  - in[0]*in[7]*in[13]  - in[4]*in[1]*in[15] + in[4]*in[3]*in[13] + in[12]*in[1]*in[7]  - in[12]*in[3]*in[5];
+    inv[14] = -in[0]*in[5]*in[14]  + in[0]*in[6]*in[13]  + in[4]*in[1]*in[14] - in[4]*in[2]*in[13] - in[12]*in[1]*in[6]  + in[12]*in[2]*in[5];
+    inv[3]  = -in[1]*in[6]*in[11]  + in[1]*in[7]*in[10]  + in[5]*in[2]*in[11] - in[5]*in[3]*in[10] - in[9]*in[2]*in[7]   + in[9]*in[3]*in[6];
+    inv[7]  =  in[0]*in[6]*in[11]  - in[0]*in[7]*in[10]  - in[4]*in[2]*in[11] + in[4]*in[3]*in[10] + in[8]*in[2]*in[7]   - in[8]*in[3]*in[6];
+    inv[11] = -in[0]*in[5]*in[11]  + in[0]*in[7]*in[9]   + in[4]*in[1]*in[11] - in[4]*in[3]*in[9]  - in[8]*in[1]*in[7]   + in[8]*in[3]*in[5];
+    inv[15] =  in[0]*in[5]*in[10]  - in[0]*in[6]*in[9]   - in[4]*in[1]*in[10] + in[4]*in[2]*in[9]  + in[8]*in[1]*in[6]   - in[8]*in[2]*in[5];
+
+    det = in[0] * inv[0] + in[1] * inv[4] + in[2] * inv[8] + in[3] * inv[12];
+    if ( det == 0.0f )
+        return GL_FALSE;
+
+    det = 1.0f / det;
+    for (i = 0; i < 16; i++)
+        out[i] = inv[i] * det;
+    return GL_TRUE;
+#endif
+}
+
+//
+// Computes the cofactor rows of the upper 3x3 of in, divided by its
+// determinant.  These are the rows of the inverse-transpose; transposed
+// they are the rows of the inverse.
+//
+static GLboolean
+matrixInverseTranspose3x3(GLfloat out[3][4], const GLfloat *in)
+{
+#ifdef ES_SIMD
+    esVec4 mask = VEC4_SET(1.0f, 1.0f, 1.0f, 0.0f);
+    esVec4 r0 = VEC4_MUL(VEC4_LOAD(in + 0), mask);
+    esVec4 r1 = VEC4_MUL(VEC4_LOAD(in + 4), mask);
+    esVec4 r2 = VEC4_MUL(VEC4_LOAD(in + 8), mask);
+    esVec4 c0 = vec3Cross(r1, r2);
+    esVec4 c1 = vec3Cross(r2, r0);
+    esVec4 c2 = vec3Cross(r0, r1);
+    esVec4 det = VEC4_MUL(r0, c0);
+
+    det = VEC4_ADD(det, VEC4_SWIZZLE(det, 1, 0, 3, 2));
+    det = VEC4_ADD(det, VEC4_SWIZZLE(det, 2, 3, 0, 1));
+    if ( VEC4_X(det) == 0.0f )
+        return GL_FALSE;
+
+    det = VEC4_DIV(VEC4_SPLAT(1.0f), det);
+    VEC4_STORE(out[0], VEC4_MUL(c0, det));
+    VEC4_STORE(out[1], VEC4_MUL(c1, det));
+    VEC4_STORE(out[2], VEC4_MUL(c2, det));
+    return GL_TRUE;
+#else
+    GLfloat det;
+    int     i;
+
+    out[0][0] = in[5] * in[10] - in[6] * in[9];
+    out[0][1] = in[6] * in[8]  - in[4] * in[10];
+    out[0][2] = in[4] * in[9]  - in[5] * in[8];
+    out[1][0] = in[9] * in[2]  - in[10] * in[1];
+    out[1][1] = in[10] * in[0] - in[8] * in[2];
+    out[1][2] = in[8] * in[1]  - in[9] * in[0];
+    out[2][0] = in[1] * in[6]  - in[2] * in[5];
+    out[2][1] = in[2] * in[4]  - in[0] * in[6];
+    out[2][2] = in[0] * in[5]  - in[1] * in[4];
+
+    det = in[0] * out[0][0] + in[1] * out[0][1] + in[2] * out[0][2];
+    if ( det == 0.0f )
+        return GL_FALSE;
+
+    det = 1.0f / det;
+    for (i = 0; i < 3; i++)
+    {
+        out[i][0] *= det;
+        out[i][1] *= det;
+        out[i][2] *= det;
+        out[i][3] = 0.0f;
+    }
+    return GL_TRUE;
+#endif
+}
+
+//
+// Inverse of a matrix whose last column is (0, 0, 0, 1), i.e. anything
+// built from esTranslate, esRotate and esScale.  The upper 3x3 is inverted
+// through its cofactors and the translation row is -t * inverse(L).
+//
+static GLboolean
+matrixInverseAffine(GLfloat *out, const GLfloat *in)
+{
+    GLfloat c[3][4];
+    GLfloat tx = in[12], ty = in[13], tz = in[14];
+
+    if ( !matrixInverseTranspose3x3(c, in) )
+        return GL_FALSE;
+
+#ifdef ES_SIMD
+    {
+        // Transpose the cofactor rows into the rows of the inverse
+        esVec4 zero = VEC4_SPLAT(0.0f);
+        esVec4 c0 = VEC4_LOAD(c[0]);
+        esVec4 c1 = VEC4_LOAD(c[1]);
+        esVec4 c2 = VEC4_LOAD(c[2]);
+        esVec4 t0 = VEC4_SHUFFLE(c0, c1, 0, 1, 0, 1);
+        esVec4 t1 = VEC4_SHUFFLE(c0, c1, 2, 3, 2, 3);
+        esVec4 t2 = VEC4_SHUFFLE(c2, zero, 0, 1, 0, 1);
+        esVec4 t3 = VEC4_SHUFFLE(c2, zero, 2, 3, 2, 3);
+        esVec4 r0 = VEC4_SHUFFLE(t0, t2, 0, 2, 0, 2);
+        esVec4 r1 = VEC4_SHUFFLE(t0, t2, 1, 3, 1, 3);
+        esVec4 r2 = VEC4_SHUFFLE(t1, t3, 0, 2, 0, 2);
+        esVec4 r3 = VEC4_ADD(VEC4_MUL(VEC4_SPLAT(tx), r0),
+                    VEC4_ADD(VEC4_MUL(VEC4_SPLAT(ty), r1),
+                             VEC4_MUL(VEC4_SPLAT(tz), r2)));
+
+        VEC4_STORE(out + 0,  r0);
+        VEC4_STORE(out + 4,  r1);
+        VEC4_STORE(out + 8,  r2);
+        VEC4_STORE(out + 12, VEC4_SUB(VEC4_SET(0.0f, 0.0f, 0.0f, 1.0f), r3));
+    }
+#else
+    out[0]  = c[0][0]; out[1]  = c[1][0]; out[2]  = c[2][0]; out[3]  = 0.0f;
+    out[4]  = c[0][1]; out[5]  = c[1][1]; out[6]  = c[2][1]; out[7]  = 0.0f;
+    out[8]  = c[0][2]; out[9]  = c[1][2]; out[10] = c[2][2]; out[11] = 0.0f;
+    out[12] = -(tx * out[0] + ty * out[4] + tz * out[8]);
+    out[13] = -(tx * out[1] + ty * out[5] + tz * out[9]);
+    out[14] = -(tx * out[2] + ty * out[6] + tz * out[10]);
+    out[15] = 1.0f;
+#endif
+    return GL_TRUE;
+}
+
+GLboolean ESUTIL_API
+esMatrixInverse(ESMatrix *result, const ESMatrix *src)
+{
+    return matrixInverse4x4(&result->m[0][0], &src->m[0][0]);
+}
+
+GLboolean ESUTIL_API
+esMatrixInverseAffine(ESMatrix *result, const ESMatrix *src)
+{
+    return matrixInverseAffine(&result->m[0][0], &src->m[0][0]);
+}
+
+GLboolean ESUTIL_API
+esMatrixNormal(ESMatrix3 *result, const ESMatrix *src)
+{
+    GLfloat c[3][4];
+    int     i;
+
+    if ( !matrixInverseTranspose3x3(c, &src->m[0][0]) )
+        return GL_FALSE;
+
+    for (i = 0; i < 3; i++)
+    {
+        result->m[i][0] = c[i][0];
+        result->m[i][1] = c[i][1];
+        result->m[i][2] = c[i][2];
+    }
+    return GL_TRUE;
+}
+
+int ESUTIL_API
+esMatrixInverseBatch(ESMatrix *out, const ESMatrix *in, int count)
+{
+    int i, inverted = 0;
+
+    for (i = 0; i < count; i++)
+        inverted += matrixInverse4x4(&out[i].m[0][0], &in[i].m[0][0]);
+    return inverted;
+}
+
+int ESUTIL_API
+esMatrixInverseAffineBatch(ESMatrix *out, const ESMatrix *in, int count)
+{
+    int i, inverted = 0;
+
+    for (i = 0; i < count; i++)
+        inverted += matrixInverseAffine(&out[i].m[0][0], &in[i].m[0][0]);
+    return inverted;
+}
+
+int ESUTIL_API
+esMatrixNormalBatch(ESMatrix3 *out, const ESMatrix *in, int count)
+{
+    int i, inverted = 0;
+
+    for (i = 0; i < count; i++)
+        inverted += esMatrixNormal(&out[i], &in[i]);
+    return inverted;
+}
+
+void ESUTIL_API
+esQuaternionFromAxisAngle(ESQuaternion *result, GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
+{
+    GLfloat mag = sqrtf(x * x + y * y + z * z);
+    GLfloat halfAngle = angle * PI / 360.0f;
+    GLfloat s;
+
+    if ( mag <= 0.0f )
+    {
+        result->x = result->y = result->z = 0.0f;
+        result->w = 1.0f;
+        return;
+    }
+
+    s = sinf(halfAngle) / mag;
+    result->x = x * s;
+    result->y = y * s;
+    result->z = z * s;
+    result->w = cosf(halfAngle);
+}
+
+void ESUTIL_API
+esQuaternionMultiply(ESQuaternion *result, const ESQuaternion *a, const ESQuaternion *b)
+{
+    ESQuaternion tmp;
+
+    tmp.x = a->w * b->x + a->x * b->w + a->y * b->z - a->z * b->y;
+    tmp.y = a->w * b->y - a->x * b->z + a->y * b->w + a->z * b->x;
+    tmp.z = a->w * b->z + a->x * b->y - a->y * b->x + a->z * b->w;
+    tmp.w = a->w * b->w - a->x * b->x - a->y * b->y - a->z * b->z;
+    *result = tmp;
+}
+
+void ESUTIL_API
+esQuaternionNormalize(ESQuaternion *q)
+{
+    GLfloat mag = sqrtf(q->x * q->x + q->y * q->y + q->z * q->z + q->w * q->w);
+
+    if ( mag > 0.0f )
+    {
+        mag = 1.0f / mag;
+        q->x *= mag;
+        q->y *= mag;
+        q->z *= mag;
+        q->w *= mag;
+    }
+}
+
+void ESUTIL_API
+esComposeTRS(ESMatrix *result, const ESVec3 *pos, const ESQuaternion *rot, const ESVec3 *scale)
+{
+    GLfloat x2 = rot->x + rot->x, y2 = rot->y + rot->y, z2 = rot->z + rot->z;
+    GLfloat xx = rot->x * x2, yy = rot->y * y2, zz = rot->z * z2;
+    GLfloat xy = rot->x * y2, yz = rot->y * z2, zx = rot->z * x2;
+    GLfloat xw = rot->w * x2, yw = rot->w * y2, zw = rot->w * z2;
+
+    // Same layout as esTranslate, esRotate and esScale applied in that
+    // order to an identity matrix: scaled rotation rows, then translation.
+    result->m[0][0] = (1.0f - yy - zz) * scale->x;
+    result->m[0][1] = (xy - zw) * scale->x;
+    result->m[0][2] = (zx + yw) * scale->x;
+    result->m[0][3] = 0.0f;
+
+    result->m[1][0] = (xy + zw) * scale->y;
+    result->m[1][1] = (1.0f - xx - zz) * scale->y;
+    result->m[1][2] = (yz - xw) * scale->y;
+    result->m[1][3] = 0.0f;
+
+    result->m[2][0] = (zx - yw) * scale->z;
+    result->m[2][1] = (yz + xw) * scale->z;
+    result->m[2][2] = (1.0f - xx - yy) * scale->z;
+    result->m[2][3] = 0.0f;
+
+    result->m[3][0] = pos->x;
+    result->m[3][1] = pos->y;
+    result->m[3][2] = pos->z;
+    result->m[3][3] = 1.0f;
+}
+
+void ESUTIL_API
+esComposeTRSBatch(ESMatrix *out, const ESTransformArrays *trs, int count)
+{
+    int i = 0;
+
+#ifdef ES_SIMD
+    // Four objects per iteration: build each matrix element for all four
+    // lanes, then transpose the lanes back out into four ESMatrix rows.
+    esVec4 zero = VEC4_SPLAT(0.0f);
+    esVec4 one  = VEC4_SPLAT(1.0f);
+
+    for ( ; i + 4 <= count; i += 4)
+    {
+        esVec4 qx = VEC4_LOAD(trs->qx + i), qy = VEC4_LOAD(trs->qy + i);
+        esVec4 qz = VEC4_LOAD(trs->qz + i), qw = VEC4_LOAD(trs->qw + i);
+        esVec4 sx = VEC4_LOAD(trs->sx + i), sy = VEC4_LOAD(trs->sy + i);
+        esVec4 sz = VEC4_LOAD(trs->sz + i);
+        esVec4 x2 = VEC4_ADD(qx, qx), y2 = VEC4_ADD(qy, qy), z2 = VEC4_ADD(qz, qz);
+        esVec4 xx = VEC4_MUL(qx, x2), yy = VEC4_MUL(qy, y2), zz = VEC4_MUL(qz, z2);
+        esVec4 xy = VEC4_MUL(qx, y2), yz = VEC4_MUL(qy, z2), zx = VEC4_MUL(qz, x2);
+        esVec4 xw = VEC4_MUL(qw, x2), yw = VEC4_MUL(qw, y2), zw = VEC4_MUL(qw, z2);
+        esVec4 r0a = VEC4_MUL(VEC4_SUB(VEC4_SUB(one, yy), zz), sx);
+        esVec4 r0b = VEC4_MUL(VEC4_SUB(xy, zw), sx);
+        esVec4 r0c = VEC4_MUL(VEC4_ADD(zx, yw), sx);
+        esVec4 r0d = zero;
+        esVec4 r1a = VEC4_MUL(VEC4_ADD(xy, zw), sy);
+        esVec4 r1b = VEC4_MUL(VEC4_SUB(VEC4_SUB(one, xx), zz), sy);
+        esVec4 r1c = VEC4_MUL(VEC4_SUB(yz, xw), sy);
+        esVec4 r1d = zero;
+        esVec4 r2a = VEC4_MUL(VEC4_SUB(zx, yw), sz);
+        esVec4 r2b = VEC4_MUL(VEC4_ADD(yz, xw), sz);
+        esVec4 r2c = VEC4_MUL(VEC4_SUB(VEC4_SUB(one, xx), yy), sz);
+        esVec4 r2d = zero;
+        esVec4 r3a = VEC4_LOAD(trs->px + i);
+        esVec4 r3b = VEC4_LOAD(trs->py + i);
+        esVec4 r3c = VEC4_LOAD(trs->pz + i);
+        esVec4 r3d = one;
+        GLfloat *dst = &out[i].m[0][0];
+
+        VEC4_TRANSPOSE(r0a, r0b, r0c, r0d);
+        VEC4_TRANSPOSE(r1a, r1b, r1c, r1d);
+        VEC4_TRANSPOSE(r2a, r2b, r2c, r2d);
+        VEC4_TRANSPOSE(r3a, r3b, r3c, r3d);
+
+        VEC4_STORE(dst + 0,  r0a); VEC4_STORE(dst + 4,  r1a); VEC4_STORE(dst + 8,  r2a); VEC4_STORE(dst + 12, r3a);
+        VEC4_STORE(dst + 16, r0b); VEC4_STORE(dst + 20, r1b); VEC4_STORE(dst + 24, r2b); VEC4_STORE(dst + 28, r3b);
+        VEC4_STORE(dst + 32, r0c); VEC4_STORE(dst + 36, r1c); VEC4_STORE(dst + 40, r2c); VEC4_STORE(dst + 44, r3c);
+        VEC4_STORE(dst + 48, r0d); VEC4_STORE(dst + 52, r1d); VEC4_STORE(dst + 56, r2d); VEC4_STORE(dst + 60, r3d);
+    }
+#endif
+
+    for ( ; i < count; i++)
+    {
+        ESVec3       pos, scale;
+        ESQuaternion rot;
+
+        pos.x = trs->px[i]; pos.y = trs->py[i]; pos.z = trs->pz[i];
+        rot.x = trs->qx[i]; rot.y = trs->qy[i]; rot.z = trs->qz[i]; rot.w = trs->qw[i];
+        scale.x = trs->sx[i]; scale.y = trs->sy[i]; scale.z = trs->sz[i];
+        esComposeTRS(&out[i], &pos, &rot, &scale);
+    }
+}
@@ -2,7 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
-#include <sys/time.h>
+#include <time.h>
+#include <math.h>
 #include <GLES2/gl2.h>
 #include <EGL/egl.h>
 #include "esUtil.h"
@@ -13,9 +14,19 @@
 
 #include  <emscripten.h>
 #include <emscripten/html5.h>
+#ifdef __EMSCRIPTEN_PTHREADS__
+#include <pthread.h>
+#endif
 
 static Display *x_display = NULL;
 
+// Canvas the context renders to; "#canvas" once transferred to the render thread
+static const char *canvasTarget = "canvas";
+
+#ifdef __EMSCRIPTEN_PTHREADS__
+static pthread_t renderThread;
+#endif
+
 EGLBoolean CreateEGLContext ( EGLNativeWindowType hWnd, EGLDisplay* eglDisplay,
                               EGLContext* eglContext, EGLSurface* eglSurface,
                               EGLint attribList[])
@@ -229,6 +240,16 @@ GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char* title, G
    esContext->totaltime = 0.0f;
    esContext->frames = 0;
 
+#ifdef __EMSCRIPTEN_PTHREADS__
+   // The context is created by the render thread in esMainLoop
+   if ( flags & ES_WINDOW_OFFSCREEN )
+   {
+      esContext->flags = flags;
+      return GL_TRUE;
+   }
+#endif
+   esContext->flags = flags & ~ES_WINDOW_OFFSCREEN;
+
    if ( !WinCreate ( esContext, title) )
    {
       return GL_FALSE;
@@ -243,29 +264,75 @@ GLboolean ESUTIL_API esCreateWindow ( ESContext *esContext, const char* title, G
    {
       return GL_FALSE;
    }
+
+   // Nothing is known about the state of a new context
+   esStateInvalidate ( );
    
 
    return GL_TRUE;
 }
 
-struct timeval t1, t2;
-struct timezone tz;
+//
+// Seconds on a monotonic clock with sub-millisecond resolution
+//
+static double nowSeconds(void){
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now() * 0.001;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
 
-void update(void* data){
-    ESContext *esContext = (ESContext*)data;
+static double lastFrameTime;
 
-    gettimeofday(&t2, &tz);
+static void runFrame(ESContext *esContext){
+    double now = nowSeconds();
     if(esContext->frames == 0){
-        t1 = t2;
+        lastFrameTime = now;
+    }
+    esContext->deltatime = (float)(now - lastFrameTime);
+    lastFrameTime = now;
+
+    if (esContext->fixedstep > 0.0f)
+    {
+        int steps = 0;
+
+        esContext->accumulator += esContext->deltatime;
+        while (esContext->accumulator >= esContext->fixedstep && steps < esContext->maxsteps)
+        {
+            if (esContext->updateFunc != NULL)
+                esContext->updateFunc(esContext, esContext->fixedstep);
+            esContext->accumulator -= esContext->fixedstep;
+            steps++;
+        }
+
+        // Still behind after maxsteps: drop the backlog instead of carrying it into the next frame
+        if (esContext->accumulator >= esContext->fixedstep)
+            esContext->accumulator = fmodf(esContext->accumulator, esContext->fixedstep);
+
+        esContext->alpha = esContext->accumulator / esContext->fixedstep;
+    }
+    else
+    {
+        if (esContext->updateFunc != NULL)
+            esContext->updateFunc(esContext, esContext->deltatime);
+        esContext->alpha = 1.0f;
     }
-    esContext->deltatime = (float)(t2.tv_sec - t1.tv_sec + (t2.tv_usec - t1.tv_usec) * 1e-6);
-    t1 = t2;
 
-    if (esContext->updateFunc != NULL)
-        esContext->updateFunc(esContext, esContext->deltatime);
     if (esContext->drawFunc != NULL)
         esContext->drawFunc(esContext);
 
+    // One IndexedDB sync for all geometry files saved this frame
+    esGeometryCacheFlush();
+}
+
+void update(void* data){
+    ESContext *esContext = (ESContext*)data;
+
+    runFrame(esContext);
+
     eglSwapBuffers(esContext->eglDisplay, esContext->eglSurface);
 
     esContext->totaltime += esContext->deltatime;
@@ -274,6 +341,46 @@ void update(void* data){
     emscripten_async_call(update, (void*)esContext, -1);
 }
 
+#ifdef __EMSCRIPTEN_PTHREADS__
+// Render thread frame; the OffscreenCanvas frame is committed when this returns to the event loop
+static void offscreenUpdate(void* data){
+    ESContext *esContext = (ESContext*)data;
+
+    runFrame(esContext);
+
+    esContext->totaltime += esContext->deltatime;
+    esContext->frames++;
+}
+
+static void *renderThreadMain(void *data){
+    ESContext *esContext = (ESContext*)data;
+    EmscriptenWebGLContextAttributes attrs;
+    EMSCRIPTEN_WEBGL_CONTEXT_HANDLE context;
+
+    emscripten_webgl_init_context_attributes(&attrs);
+    attrs.alpha = (esContext->flags & ES_WINDOW_ALPHA) != 0;
+    attrs.depth = (esContext->flags & ES_WINDOW_DEPTH) != 0;
+    attrs.stencil = (esContext->flags & ES_WINDOW_STENCIL) != 0;
+    attrs.antialias = (esContext->flags & ES_WINDOW_MULTISAMPLE) != 0;
+    attrs.majorVersion = 1;
+    attrs.minorVersion = 0;
+
+    context = emscripten_webgl_create_context(canvasTarget, &attrs);
+    if (context <= 0 || emscripten_webgl_make_context_current(context) != EMSCRIPTEN_RESULT_SUCCESS){
+        esLogMessage("Could not create a WebGL context on the render thread\n");
+        return NULL;
+    }
+    emscripten_set_canvas_element_size(canvasTarget, esContext->width, esContext->height);
+    esStateInvalidate();
+
+    if (esContext->initFunc != NULL && !esContext->initFunc(esContext))
+        return NULL;
+
+    // Unwinds and keeps the thread alive, running one frame per animation frame
+    emscripten_set_main_loop_arg(offscreenUpdate, esContext, 0, 1);
+    return NULL;
+}
+#endif
 
 EM_BOOL mouseMoveCallback(int eventType, const EmscriptenMouseEvent *mouseEvent, void *userData){
     printf("mousemove %ld %ld\n", mouseEvent->canvasX, mouseEvent->canvasY);
@@ -297,12 +404,17 @@ EM_BOOL mouseClickCallback(int eventType, const EmscriptenMouseEvent *mouseEvent
 
 EM_BOOL resizeCallback(int eventType, const EmscriptenUiEvent *event, void *userData){
     printf("resize %d %d\n", event->windowInnerWidth, event->windowInnerHeight);
-    //emscripten_set_element_css_size("canvas", event->windowInnerWidth, event->windowInnerHeight);
-    emscripten_set_canvas_element_size("canvas", event->windowInnerWidth, event->windowInnerHeight);
+
+    // Keep the CSS size in page pixels and give the canvas one pixel per device pixel
+    double ratio = emscripten_get_device_pixel_ratio();
+    int width = (int)(event->windowInnerWidth * ratio + 0.5);
+    int height = (int)(event->windowInnerHeight * ratio + 0.5);
+    emscripten_set_element_css_size(canvasTarget, event->windowInnerWidth, event->windowInnerHeight);
+    emscripten_set_canvas_element_size(canvasTarget, width, height);
     
     ESContext* esContext = (ESContext*)userData;
-    esContext->width = event->windowInnerWidth;
-    esContext->height = event->windowInnerHeight;
+    esContext->width = width;
+    esContext->height = height;
 
     return false;
 }
@@ -320,6 +432,38 @@ EM_BOOL wheelCallback(int eventType, const EmscriptenWheelEvent *event, void *us
 
 void ESUTIL_API esMainLoop ( ESContext *esContext )
 {
+#ifdef __EMSCRIPTEN_PTHREADS__
+    if (esContext->flags & ES_WINDOW_OFFSCREEN)
+    {
+        pthread_attr_t attr;
+
+        canvasTarget = "#canvas";
+        pthread_attr_init(&attr);
+        emscripten_pthread_attr_settransferredcanvases(&attr, canvasTarget);
+        if (pthread_create(&renderThread, &attr, renderThreadMain, esContext) != 0){
+            esLogMessage("Could not start the render thread\n");
+            pthread_attr_destroy(&attr);
+            return;
+        }
+        pthread_attr_destroy(&attr);
+
+        // Events arrive on the main thread and are forwarded to the render thread
+        emscripten_set_mousemove_callback_on_thread("canvas",esContext,false,mouseMoveCallback,renderThread);
+        emscripten_set_mousedown_callback_on_thread("canvas",esContext,false,mouseDownCallback,renderThread);
+        emscripten_set_mouseup_callback_on_thread("canvas",esContext,false,mouseUpCallback,renderThread);
+        emscripten_set_click_callback_on_thread("canvas",esContext,false,mouseClickCallback,renderThread);
+
+        emscripten_set_resize_callback_on_thread(EMSCRIPTEN_EVENT_TARGET_WINDOW,esContext,false,resizeCallback,renderThread);
+        emscripten_set_scroll_callback_on_thread(EMSCRIPTEN_EVENT_TARGET_WINDOW,esContext,false,scrollCallback,renderThread);
+
+        emscripten_set_wheel_callback_on_thread("canvas",esContext,false,wheelCallback,renderThread);
+        return;
+    }
+#endif
+
+    if (esContext->initFunc != NULL && !esContext->initFunc(esContext))
+        return;
+
     emscripten_set_mousemove_callback("canvas",esContext,false,mouseMoveCallback);
     emscripten_set_mousedown_callback("canvas",esContext,false,mouseDownCallback);
     emscripten_set_mouseup_callback("canvas",esContext,false,mouseUpCallback);
@@ -334,6 +478,11 @@ void ESUTIL_API esMainLoop ( ESContext *esContext )
 }
 
 
+void ESUTIL_API esRegisterInitFunc ( ESContext *esContext, int (ESCALLBACK *initFunc) ( ESContext* ) )
+{
+   esContext->initFunc = initFunc;
+}
+
 void ESUTIL_API esRegisterDrawFunc ( ESContext *esContext, void (ESCALLBACK *drawFunc) (ESContext* ) )
 {
    esContext->drawFunc = drawFunc;
@@ -344,6 +493,14 @@ void ESUTIL_API esRegisterUpdateFunc ( ESContext *esContext, void (ESCALLBACK *u
    esContext->updateFunc = updateFunc;
 }
 
+void ESUTIL_API esSetFixedTimestep ( ESContext *esContext, float step, int maxSteps )
+{
+   esContext->fixedstep = step > 0.0f ? step : 0.0f;
+   esContext->maxsteps = maxSteps > 0 ? maxSteps : 1;
+   esContext->accumulator = 0.0f;
+   esContext->alpha = 1.0f;
+}
+
 void ESUTIL_API esRegisterKeyFunc ( ESContext *esContext,
                                     void (ESCALLBACK *keyFunc) (ESContext*, unsigned char, int, int ) )
 {
@@ -362,3 +519,29 @@ void ESUTIL_API esLogMessage ( const char *formatStr, ... )
     
     va_end ( params );
 }
+
+GLboolean ESUTIL_API esHasExtension ( const char *name )
+{
+    const char *ext = (const char *)glGetString ( GL_EXTENSIONS );
+    size_t len = strlen ( name );
+
+    if ( ext == NULL )
+        return GL_FALSE;
+
+    // Match whole space separated names; WebGL reports some without the GL_ prefix
+    while ( *ext )
+    {
+        const char *end = strchr ( ext, ' ' );
+        size_t extLen = end ? (size_t)( end - ext ) : strlen ( ext );
+
+        if ( ( extLen == len && strncmp ( ext, name, len ) == 0 ) ||
+             ( extLen == len - 3 && strncmp ( name, "GL_", 3 ) == 0 && strncmp ( ext, name + 3, extLen ) == 0 ) ||
+             ( extLen == len + 3 && strncmp ( ext, "GL_", 3 ) == 0 && strncmp ( ext + 3, name, len ) == 0 ) )
+            return GL_TRUE;
+
+        if ( end == NULL )
+            break;
+        ext = end + 1;
+    }
+    return GL_FALSE;
+}
@@ -0,0 +1,271 @@
+// esVertexFormat.c
+//
+//    Packs the interleaved float vertices produced by the esGen* functions
+//    into compact quantized formats, and describes the resulting layout for
+//    glVertexAttribPointer.
+//
+
+///
+//  Includes
+//
+#include "esUtil.h"
+#include <GLES2/gl2ext.h>
+#include <math.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+static void setAttrib ( ESVertexAttrib *attrib, GLint size, GLenum type, GLboolean normalized,
+                        GLsizei bytes, GLsizei *offset )
+{
+   attrib->size = size;
+   attrib->type = type;
+   attrib->normalized = normalized;
+   attrib->offset = *offset;
+   // Keep every attribute 4-byte aligned, as WebGL requires for most types
+   *offset += ( bytes + 3 ) & ~3;
+}
+
+static GLshort toSnorm16 ( GLfloat v )
+{
+   v = v < -1.0f ? -1.0f : ( v > 1.0f ? 1.0f : v );
+   return (GLshort)floorf ( v * 32767.0f + 0.5f );
+}
+
+static signed char toSnorm8 ( GLfloat v )
+{
+   v = v < -1.0f ? -1.0f : ( v > 1.0f ? 1.0f : v );
+   return (signed char)floorf ( v * 127.0f + 0.5f );
+}
+
+static GLushort toUnorm16 ( GLfloat v )
+{
+   v = v < 0.0f ? 0.0f : ( v > 1.0f ? 1.0f : v );
+   return (GLushort)floorf ( v * 65535.0f + 0.5f );
+}
+
+//
+// IEEE 754 binary32 -> binary16, round to nearest even, with overflow to
+// infinity and gradual underflow to denormals
+//
+static GLushort toHalf ( GLfloat f )
+{
+   union { GLfloat f; GLuint u; } bits;
+   GLuint sign, mantissa, half, rem;
+   int exponent;
+
+   bits.f = f;
+   sign = ( bits.u >> 16 ) & 0x8000;
+   exponent = (int)( ( bits.u >> 23 ) & 0xFF );
+   mantissa = bits.u & 0x7FFFFF;
+
+   // Inf and NaN
+   if ( exponent == 0xFF )
+      return (GLushort)( sign | 0x7C00 | ( mantissa ? 0x200 : 0 ) );
+
+   // Rebias from 127 to 15
+   exponent -= 112;
+   if ( exponent >= 31 )
+      return (GLushort)( sign | 0x7C00 );
+
+   if ( exponent <= 0 )
+   {
+      int shift = 14 - exponent;
+
+      if ( exponent < -10 )
+         return (GLushort)sign;
+
+      mantissa |= 0x800000;
+      half = mantissa >> shift;
+      rem = mantissa & ( ( 1u << shift ) - 1 );
+      if ( rem > ( 1u << ( shift - 1 ) ) || ( rem == ( 1u << ( shift - 1 ) ) && ( half & 1 ) ) )
+         half++;
+      return (GLushort)( sign | half );
+   }
+
+   // A carry out of the mantissa correctly bumps the exponent
+   half = ( (GLuint)exponent << 10 ) | ( mantissa >> 13 );
+   rem = mantissa & 0x1FFF;
+   if ( rem > 0x1000 || ( rem == 0x1000 && ( half & 1 ) ) )
+      half++;
+   return (GLushort)( sign | half );
+}
+
+//
+// Octahedral normal encoding: project onto the octahedron |x|+|y|+|z| = 1
+// and fold the lower hemisphere over the diagonals into a [-1,1]^2 square
+//
+static void octEncode ( const GLfloat *n, GLfloat *e )
+{
+   GLfloat l1 = fabsf ( n[0] ) + fabsf ( n[1] ) + fabsf ( n[2] );
+   GLfloat x, y;
+
+   if ( l1 <= 0.0f )
+   {
+      e[0] = e[1] = 0.0f;
+      return;
+   }
+
+   x = n[0] / l1;
+   y = n[1] / l1;
+   if ( n[2] < 0.0f )
+   {
+      GLfloat fx = ( 1.0f - fabsf ( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+      GLfloat fy = ( 1.0f - fabsf ( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+      x = fx;
+      y = fy;
+   }
+   e[0] = x;
+   e[1] = y;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+void ESUTIL_API esVertexLayoutInit ( GLuint format, ESVertexLayout *layout )
+{
+   GLsizei offset = 0;
+
+   memset ( layout, 0, sizeof(ESVertexLayout) );
+
+   // WebGL has no half float vertex attributes
+   if ( ( format & ES_VERTEX_POSITION_HALF ) && !esHasExtension ( "GL_OES_vertex_half_float" ) )
+      format &= ~ES_VERTEX_POSITION_HALF;
+
+   layout->format = format;
+   layout->positionScale = 1.0f;
+   layout->texCoordScale[0] = layout->texCoordScale[1] = 1.0f;
+
+   if ( format & ES_VERTEX_POSITION_HALF )
+      setAttrib ( &layout->position, 3, GL_HALF_FLOAT_OES, GL_FALSE, 3 * sizeof(GLushort), &offset );
+   else if ( format & ES_VERTEX_POSITION_SNORM16 )
+      setAttrib ( &layout->position, 3, GL_SHORT, GL_TRUE, 3 * sizeof(GLshort), &offset );
+   else
+      setAttrib ( &layout->position, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), &offset );
+
+   if ( format & ES_VERTEX_NORMAL_OCT8 )
+      setAttrib ( &layout->normal, 2, GL_BYTE, GL_TRUE, 2, &offset );
+   else if ( format & ES_VERTEX_NORMAL_OCT16 )
+      setAttrib ( &layout->normal, 2, GL_SHORT, GL_TRUE, 2 * sizeof(GLshort), &offset );
+   else
+      setAttrib ( &layout->normal, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), &offset );
+
+   if ( format & ES_VERTEX_TEXCOORD_UNORM16 )
+      setAttrib ( &layout->texCoord, 2, GL_UNSIGNED_SHORT, GL_TRUE, 2 * sizeof(GLushort), &offset );
+   else
+      setAttrib ( &layout->texCoord, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), &offset );
+
+   layout->stride = offset;
+}
+
+int ESUTIL_API esPackVertices ( GLuint format, const GLfloat *src, int numVertices, void *dst, ESVertexLayout *layout )
+{
+   GLfloat maxAbs = 0.0f;
+   GLfloat invScale;
+   GLfloat invTexScale[2];
+   int i, c;
+
+   esVertexLayoutInit ( format, layout );
+   format = layout->format;
+
+   if ( format & ES_VERTEX_POSITION_SNORM16 )
+   {
+      for ( i = 0; i < numVertices * 8; i += 8 )
+         for ( c = 0; c < 3; c++ )
+            maxAbs = fabsf ( src[i + c] ) > maxAbs ? fabsf ( src[i + c] ) : maxAbs;
+      layout->positionScale = maxAbs > 0.0f ? maxAbs : 1.0f;
+   }
+   invScale = 1.0f / layout->positionScale;
+
+   // Map each texcoord component's range onto [0, 1]; esGenSphere v runs below 0
+   if ( format & ES_VERTEX_TEXCOORD_UNORM16 )
+   {
+      for ( c = 0; c < 2; c++ )
+      {
+         GLfloat lo = numVertices > 0 ? src[6 + c] : 0.0f;
+         GLfloat hi = lo;
+
+         for ( i = 0; i < numVertices * 8; i += 8 )
+         {
+            lo = src[i + 6 + c] < lo ? src[i + 6 + c] : lo;
+            hi = src[i + 6 + c] > hi ? src[i + 6 + c] : hi;
+         }
+         layout->texCoordBias[c] = lo;
+         layout->texCoordScale[c] = hi > lo ? hi - lo : 1.0f;
+      }
+   }
+   invTexScale[0] = 1.0f / layout->texCoordScale[0];
+   invTexScale[1] = 1.0f / layout->texCoordScale[1];
+
+   for ( i = 0; i < numVertices; i++, src += 8 )
+   {
+      char *vert = (char *)dst + i * layout->stride;
+      char *pos = vert + layout->position.offset;
+      char *nrm = vert + layout->normal.offset;
+      char *tex = vert + layout->texCoord.offset;
+      GLfloat oct[2];
+
+      for ( c = 0; c < 3; c++ )
+      {
+         if ( format & ES_VERTEX_POSITION_HALF )
+            ((GLushort *)pos)[c] = toHalf ( src[c] );
+         else if ( format & ES_VERTEX_POSITION_SNORM16 )
+            ((GLshort *)pos)[c] = toSnorm16 ( src[c] * invScale );
+         else
+            ((GLfloat *)pos)[c] = src[c];
+      }
+
+      if ( format & ( ES_VERTEX_NORMAL_OCT8 | ES_VERTEX_NORMAL_OCT16 ) )
+      {
+         octEncode ( src + 3, oct );
+         for ( c = 0; c < 2; c++ )
+         {
+            if ( format & ES_VERTEX_NORMAL_OCT8 )
+               ((signed char *)nrm)[c] = toSnorm8 ( oct[c] );
+            else
+               ((GLshort *)nrm)[c] = toSnorm16 ( oct[c] );
+         }
+      }
+      else
+      {
+         memcpy ( nrm, src + 3, 3 * sizeof(GLfloat) );
+      }
+
+      for ( c = 0; c < 2; c++ )
+      {
+         if ( format & ES_VERTEX_TEXCOORD_UNORM16 )
+            ((GLushort *)tex)[c] = toUnorm16 ( ( src[6 + c] - layout->texCoordBias[c] ) * invTexScale[c] );
+         else
+            ((GLfloat *)tex)[c] = src[6 + c];
+      }
+   }
+
+   return numVertices * layout->stride;
+}
+
+void ESUTIL_API esVertexLayoutBind ( const ESVertexLayout *layout, GLint positionLoc, GLint normalLoc,
+                                     GLint texCoordLoc, GLsizei baseOffset )
+{
+   const ESVertexAttrib *attribs[3];
+   GLint locs[3];
+   int i;
+
+   attribs[0] = &layout->position;  locs[0] = positionLoc;
+   attribs[1] = &layout->normal;    locs[1] = normalLoc;
+   attribs[2] = &layout->texCoord;  locs[2] = texCoordLoc;
+
+   for ( i = 0; i < 3; i++ )
+   {
+      if ( locs[i] < 0 )
+         continue;
+      esStateVertexAttribPointer ( locs[i], attribs[i]->size, attribs[i]->type, attribs[i]->normalized,
+                              layout->stride, (char *)0 + baseOffset + attribs[i]->offset );
+   }
+}
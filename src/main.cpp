@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "esUtil.h"
+#include "esMath.hpp"
 #include  <emscripten.h>
 #include <emscripten/html5.h>
 #include <math.h>
@@ -10,6 +11,7 @@
 #include <AL/al.h>
 #include <AL/alc.h>
 #include <cstring>
+#include <atomic>
 
 
 
@@ -197,152 +199,159 @@ int audioMain()
 
 typedef struct
 {
-   GLuint programObject;
-} UserData;
+   ESShaderSource shader;
 
-GLuint LoadShader ( GLenum type, const char *shaderSrc )
-{
-   GLuint shader;
-   GLint compiled;
-   
-   shader = glCreateShader ( type );
+   // Triangle rotation after the last two simulation steps
+   float prevAngle;
+   float angle;
 
-   if ( shader == 0 )
-   	return 0;
+   // Renders below window resolution when the GPU cannot keep up
+   ESDynamicResolution resolution;
 
-   glShaderSource ( shader, 1, &shaderSrc, NULL );
-   glCompileShader ( shader );
-   glGetShaderiv ( shader, GL_COMPILE_STATUS, &compiled );
+   // Loaded from the IDBFS geometry cache on warm starts
+   const ESGeometry *sphere;
+} UserData;
 
-   if ( !compiled ) 
-   {
-      GLint infoLen = 0;
-      glGetShaderiv ( shader, GL_INFO_LOG_LENGTH, &infoLen );
-      
-      if ( infoLen > 1 )
-      {
-         char* infoLog = (char*)malloc (sizeof(char) * infoLen );
-
-         glGetShaderInfoLog ( shader, infoLen, NULL, infoLog );
-         esLogMessage ( "Error compiling shader:\n%s\n", infoLog );            
-         
-         free ( infoLog );
-      }
-
-      glDeleteShader ( shader );
-      return 0;
-   }
-   return shader;
-}
+// Set by cacheReady once IDBFS has filled /working1 from IndexedDB
+static std::atomic<bool> cacheMounted(false);
+
+/// Feature bits of the sample shader
+#define FEATURE_PULSE 1
+
+static const char* vShaderStr =  
+   "attribute vec4 vPosition;    \n"
+   "void main()                  \n"
+   "{                            \n"
+   "   gl_Position = vPosition;  \n"
+   "}                            \n";
+
+static const char* fShaderStr =  
+   "precision mediump float;\n"\
+   "#ifdef PULSE\n"
+   "uniform float uTime;\n"
+   "#endif\n"
+   "void main()                                  \n"
+   "{                                            \n"
+   "#ifdef PULSE\n"
+   "  gl_FragColor = vec4 ( 0.5 + 0.5 * sin ( uTime * 4.0 ), 0.0, 0.0, 1.0 );\n"
+   "#else\n"
+   "  gl_FragColor = vec4 ( 1.0, 0.0, 0.0, 1.0 );\n"
+   "#endif\n"
+   "}                                            \n";
+
+static const char* features[] = { "PULSE", NULL };
+static const char* attribs[] = { "vPosition", NULL };
+static const char* uniforms[] = { "uTime", NULL };
+
+// Triangle corners at zero angle, 120 degrees apart on a circle of radius 0.9
+static constexpr es::Vec3 corners[3] =
+{
+   es::Vec3(  0.0f,          0.9f,  0.0f ),
+   es::Vec3(  0.779422863f, -0.45f, 0.0f ),
+   es::Vec3( -0.779422863f, -0.45f, 0.0f )
+};
 
 ///
-// Initialize the shader and program object
+// Set up the shader; its variants compile the first time they are drawn
 //
 int Init ( ESContext *esContext )
 {
    esContext->userData = malloc(sizeof(UserData));
 
    UserData *userData = (UserData *)esContext->userData;
-   const char* vShaderStr =  
-      "attribute vec4 vPosition;    \n"
-      "void main()                  \n"
-      "{                            \n"
-      "   gl_Position = vPosition;  \n"
-      "}                            \n";
-   
-   const char* fShaderStr =  
-      "precision mediump float;\n"\
-      "void main()                                  \n"
-      "{                                            \n"
-      "  gl_FragColor = vec4 ( 1.0, 0.0, 0.0, 1.0 );\n"
-      "}                                            \n";
-
-   GLuint vertexShader;
-   GLuint fragmentShader;
-   GLuint programObject;
-   GLint linked;
-
-   // Load the vertex/fragment shaders
-   vertexShader = LoadShader ( GL_VERTEX_SHADER, vShaderStr );
-   fragmentShader = LoadShader ( GL_FRAGMENT_SHADER, fShaderStr );
-
-   // Create the program object
-   programObject = glCreateProgram ( );
-   
-   if ( programObject == 0 )
-      return 0;
-
-   glAttachShader ( programObject, vertexShader );
-   glAttachShader ( programObject, fragmentShader );
-
-   // Bind vPosition to attribute 0   
-   glBindAttribLocation ( programObject, 0, "vPosition" );
 
-   // Link the program
-   glLinkProgram ( programObject );
+   userData->prevAngle = userData->angle = 0.0f;
+   userData->sphere = NULL;
 
-   // Check the link status
-   glGetProgramiv ( programObject, GL_LINK_STATUS, &linked );
+   // vPosition is bound to attribute 0
+   esShaderSourceInit ( &userData->shader, vShaderStr, fShaderStr, features, attribs, uniforms );
 
-   if ( !linked ) 
-   {
-      GLint infoLen = 0;
-
-      glGetProgramiv ( programObject, GL_INFO_LOG_LENGTH, &infoLen );
-      
-      if ( infoLen > 1 )
-      {
-         char* infoLog = (char*)malloc (sizeof(char) * infoLen );
+   // Request the plain variant now so it is usually ready by the first frame
+   esShaderVariantGet ( &userData->shader, 0 );
 
-         glGetProgramInfoLog ( programObject, infoLen, NULL, infoLog );
-         esLogMessage ( "Error linking program:\n%s\n", infoLog );            
-         
-         free ( infoLog );
-      }
-
-      glDeleteProgram ( programObject );
+   // Dynamic vertex data is streamed through a ring of reused buffers
+   if ( !esStreamInit ( 64 * 1024 ) )
       return GL_FALSE;
-   }
 
-   // Store the program object
-   userData->programObject = programObject;
+   if ( !esDynamicResolutionInit ( &userData->resolution, 1.0f / 60.0f, 0.5f, GL_FALSE ) )
+      return GL_FALSE;
 
    glClearColor ( 0.0f, 0.0f, 0.0f, 0.0f );
    return GL_TRUE;
 }
 
+///
+// Advance the simulation by one fixed step
+//
+void Update ( ESContext *esContext, float deltaTime )
+{
+   UserData *userData = (UserData *)esContext->userData;
+
+   userData->prevAngle = userData->angle;
+   userData->angle += deltaTime;
+}
+
 void Draw ( ESContext *esContext )
 {
    UserData *userData = (UserData *)esContext->userData;
-   GLfloat vVertices[] = {
-       0.9f*sin(esContext->totaltime + 2.0f * 0.0f * float(M_PI) / 3.0f),
-       0.9f*cos(esContext->totaltime + 2.0f * 0.0f * float(M_PI) / 3.0f),
-       0.0f,
-
-       0.9f*sin(esContext->totaltime + 2.0f * 1.0f * float(M_PI) / 3.0f),
-       0.9f*cos(esContext->totaltime + 2.0f * 1.0f * float(M_PI) / 3.0f),
-       0.0f, 
-
-       0.9f*sin(esContext->totaltime + 2.0f * 2.0f * float(M_PI) / 3.0f),
-       0.9f*cos(esContext->totaltime + 2.0f * 2.0f * float(M_PI) / 3.0f),
-       0.0f
+
+   // Alternate between the plain and pulsing variants every few seconds,
+   // drawing the plain one while the pulsing one is still compiling
+   GLuint mask = ( (int)( esContext->totaltime / 3.0f ) & 1 ) ? FEATURE_PULSE : 0;
+   esProgramPoll();
+   const ESShaderVariant *variant = esShaderVariantGet ( &userData->shader, mask );
+   if ( variant == NULL )
+      variant = esShaderVariantGet ( &userData->shader, 0 );
+   if ( variant == NULL )
+   {
+      glClear ( GL_COLOR_BUFFER_BIT );
+      return;
+   }
+
+   // Draw between the last two steps so motion stays smooth at any refresh rate
+   float angle = userData->prevAngle + ( userData->angle - userData->prevAngle ) * esContext->alpha;
+
+   // One rotation for all corners; es:: math is header-only, so it can inline here
+   const es::Mat4 spin = es::Mat4::rotation(es::Quat::axisAngle(angle * (180.0f / float(M_PI)),
+                                                                es::Vec3(0.0f, 0.0f, 1.0f)));
+   const es::Vec3 vVertices[3] = {
+       spin.transformPoint(corners[0]),
+       spin.transformPoint(corners[1]),
+       spin.transformPoint(corners[2])
    };
 
-   // No clientside arrays, so do this in a webgl-friendly manner
-   GLuint vertexPosObject;
-   glGenBuffers(1, &vertexPosObject);
-   glBindBuffer(GL_ARRAY_BUFFER, vertexPosObject);
-   glBufferData(GL_ARRAY_BUFFER, 9*4, vVertices, GL_DYNAMIC_DRAW);
+   // No clientside arrays, so stream the vertices through a GL buffer
+   ESStreamAlloc vertexPos = esStreamAlloc(sizeof(vVertices));
+   if ( vertexPos.ptr == NULL )
+      return;
+   memcpy(vertexPos.ptr, vVertices, sizeof(vVertices));
+   esStreamFlush();
    
-   glViewport ( 0, 0, esContext->width, esContext->height );
+   // State that did not change since the last frame is not re-sent to GL
+   esDynamicResolutionBegin ( &userData->resolution, esContext );
    glClear ( GL_COLOR_BUFFER_BIT );
-   glUseProgram ( userData->programObject );
+   esStateUseProgram ( variant->program->program );
+   // Resolved once per variant, and only uploaded when the value changes
+   ESReflection *reflection = variant->program->reflection;
+   if ( reflection != NULL )
+      esSetUniform1f ( reflection, variant->uniformVars[0], esContext->totaltime );
 
-   glBindBuffer(GL_ARRAY_BUFFER, vertexPosObject);
-   glVertexAttribPointer(0 /* ? */, 3, GL_FLOAT, 0, 0, 0);
-   glEnableVertexAttribArray(0);
+   esStateBindBuffer(GL_ARRAY_BUFFER, vertexPos.buffer);
+   esStateVertexAttribPointer(variant->attribLocs[0], 3, GL_FLOAT, 0, 0, (char *)0 + vertexPos.offset);
+   esStateEnableVertexAttribArray(variant->attribLocs[0]);
 
    glDrawArrays ( GL_TRIANGLES, 0, 3 );
+
+   // Geometry waits for the populated cache, so a warm start loads the sphere instead of generating it
+   if ( userData->sphere == NULL && cacheMounted.load() )
+   {
+      esGeometryCachePersist ( "/working1" );
+      userData->sphere = esGeometryAcquire ( ES_SHAPE_SPHERE, 64, 0.25f, 0 );
+   }
+   if ( userData->sphere != NULL )
+      esDrawGeometry ( userData->sphere, variant->attribLocs[0], -1, -1 );
+
+   esDynamicResolutionEnd ( &userData->resolution, esContext );
 }
 
 ESContext esContext;
@@ -377,6 +386,11 @@ extern "C" {
        printf("running test!\n");
        test2();
     }
+
+    // Called on the main thread once FS.syncfs(true) has populated /working1
+    void cacheReady() {
+       cacheMounted.store(true);
+    }
 };
 
 int main ( int argc, char *argv[] )
@@ -384,8 +398,27 @@ int main ( int argc, char *argv[] )
    esInitContext ( &esContext );
    esContext.userData = &userData;
 
-   int width, height;
-   emscripten_get_canvas_element_size("canvas", &width, &height);
+  // Mount and populate IDBFS before anything can read or write the geometry cache
+  EM_ASM(
+    FS.mkdir('/working1');
+    FS.mount(IDBFS, {}, '/working1');
+    console.log("asdasd");
+    FS.syncfs(true, function (err) {
+      assert(!err);
+      ccall('test', 'v');
+      ccall('cacheReady', 'v');
+    });
+  );
+
+   // Keep the CSS size in page pixels and give the canvas one pixel per device pixel,
+   // as the resize callback does
+   double cssWidth, cssHeight;
+   emscripten_get_element_css_size("canvas", &cssWidth, &cssHeight);
+   double ratio = emscripten_get_device_pixel_ratio();
+   int width = (int)(cssWidth * ratio + 0.5);
+   int height = (int)(cssHeight * ratio + 0.5);
+   emscripten_set_element_css_size("canvas", cssWidth, cssHeight);
+   emscripten_set_canvas_element_size("canvas", width, height);
    esCreateWindow ( &esContext, "Hello Triangle", width, height, ES_WINDOW_RGB );
 
     printf("asdasd\n");
@@ -394,18 +427,12 @@ int main ( int argc, char *argv[] )
       return 0;
 
    esRegisterDrawFunc ( &esContext, Draw );
+   esRegisterUpdateFunc ( &esContext, Update );
 
-   esMainLoop ( &esContext );
+   // Simulate at 60 Hz whatever the display rate, catching up at most 5 steps per frame
+   esSetFixedTimestep ( &esContext, 1.0f / 60.0f, 5 );
 
-  EM_ASM(
-    FS.mkdir('/working1');
-    FS.mount(IDBFS, {}, '/working1');
-    console.log("asdasd");
-    FS.syncfs(true, function (err) {
-      assert(!err);
-      ccall('test', 'v');
-    });
-  );
+   esMainLoop ( &esContext );
 
 
     // audio